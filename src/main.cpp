@@ -14,6 +14,15 @@
 #include <map>
 #include <queue>       
 #include <unordered_set> 
+#include <unordered_map>
+#include <deque>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <array>
 
 const uint16 PLAYER_CATEGORY = 0x0001;
 const uint16 ENEMY_CATEGORY = 0x0002;
@@ -25,6 +34,43 @@ const uint16 HEALTH_CATEGORY = 0x0040;
 const uint16 TRAP_CATEGORY = 0x0080;
 const uint16 EXIT_CATEGORY = 0x0100;
 
+// Вид сущности определяется битом категории фикстуры, а userData.pointer хранит
+// её идентификатор: хэндл врага, индекс предмета в его векторе или указатель на пулю
+enum class EntityKind : uint8_t {
+    NONE = 0,
+    PLAYER,
+    ENEMY,
+    BULLET,
+    WALL,
+    DOOR,
+    KEY,
+    HEALTH,
+    TRAP,
+    EXIT,
+    COUNT
+};
+
+EntityKind entityKindOf(uint16 categoryBits) {
+    switch (categoryBits) {
+    case PLAYER_CATEGORY: return EntityKind::PLAYER;
+    case ENEMY_CATEGORY: return EntityKind::ENEMY;
+    case BULLET_CATEGORY: return EntityKind::BULLET;
+    case WALL_CATEGORY: return EntityKind::WALL;
+    case DOOR_CATEGORY: return EntityKind::DOOR;
+    case KEY_CATEGORY: return EntityKind::KEY;
+    case HEALTH_CATEGORY: return EntityKind::HEALTH;
+    case TRAP_CATEGORY: return EntityKind::TRAP;
+    case EXIT_CATEGORY: return EntityKind::EXIT;
+    default: return EntityKind::NONE;
+    }
+}
+
+void tagFixtures(b2Body* body, uintptr_t id) {
+    for (b2Fixture* fixture = body->GetFixtureList(); fixture; fixture = fixture->GetNext()) {
+        fixture->GetUserData().pointer = id;
+    }
+}
+
 enum CellType {
     EMPTY = 0,
     WALL = 1,
@@ -43,6 +89,7 @@ struct Player {
     sf::CircleShape shape;
     sf::ConvexShape directionArc;
     b2Body* body;
+    sf::Vector2f previousPosition;
     int lives;
     float speed;
     float angle;
@@ -52,6 +99,7 @@ struct Player {
     float lastShotTime = 0.0f;
     float enemyStartDelayTimer = 3.0f;
     bool enemiesCanMove = false;
+    int weapon = 0;
 };
 struct Exit {
     sf::RectangleShape shape;
@@ -61,12 +109,14 @@ struct Exit {
 struct Key {
     sf::RectangleShape shape;
     b2Body* body;
+    sf::Vector2i cell;
     bool collected = false;
 };
 
 struct Door {
     sf::RectangleShape shape;
     b2Body* body;
+    sf::Vector2i cell;
     bool opened = false;
     bool toDestroy = false;  
 };
@@ -80,20 +130,6 @@ struct HealthPickup {
     float pulseTime = 0.0f;
 };
 
-struct Pit {
-    sf::RectangleShape shape;
-};
-
-struct Wall {
-    sf::RectangleShape shape;
-    b2Body* body;
-};
-
-struct Heart {
-    sf::CircleShape shape;
-    bool isBonus; 
-};
-
 struct Node {
     int x, y;
     float g, h;
@@ -104,35 +140,421 @@ struct Node {
     float getF() const { return g + h; }
 };
 
-std::vector<std::vector<int>> currentLevelMap;
 float cellSize = 32.0f;
+// Сетка проходимости уровня: по биту на клетку (1 — можно пройти), закрытая дверь
+// считается стеной. Версия растёт при каждом изменении, по ней кэши путей
+// понимают, что карта поменялась.
+class NavGrid {
+public:
+    void build(const std::vector<std::vector<int>>& map, bool doorsBlocked = true) {
+        height = static_cast<int>(map.size());
+        width = height > 0 ? static_cast<int>(map[0].size()) : 0;
+        bits.assign((static_cast<size_t>(width) * height + 63) / 64, 0);
+        openCells = 0;
+        for (int y = 0; y < height; ++y) {
+            int rowWidth = std::min(width, static_cast<int>(map[y].size()));
+            for (int x = 0; x < rowWidth; ++x) {
+                int cell = map[y][x];
+                if (cell != WALL && cell != PIT && !(doorsBlocked && cell == DOOR)) {
+                    size_t index = static_cast<size_t>(y) * width + x;
+                    bits[index >> 6] |= uint64_t(1) << (index & 63);
+                    openCells++;
+                }
+            }
+        }
+        version++;
+    }
 
-// Структура врага
-struct Enemy {
-    sf::CircleShape shape;
-    b2Body* body;
-    float speed;
-    int health;
-    bool isStrong = false;
-    float stunTimer = 0.0f;
-    std::vector<sf::Vector2i> patrolPath;
-    size_t currentPatrolPoint = 0;
-    float idleTimer = 0.0f;
-    std::vector<sf::Vector2i> path;
-    float recalculatePathTimer = 0.0f;
-    bool toDestroy = false;
-    bool isPursuing = false;
-    float pursuitTimer = 0.0f;
-    float lastSeenPlayerTime = 0.0f;
-    float patrolChangeTimer = 0.0f; 
-    bool hasSeenPlayer = false;
+    bool setWalkable(int x, int y, bool walkable) {
+        if (x < 0 || y < 0 || x >= width || y >= height || isWalkable(x, y) == walkable) {
+            return false;
+        }
+        size_t index = static_cast<size_t>(y) * width + x;
+        bits[index >> 6] ^= uint64_t(1) << (index & 63);
+        openCells += walkable ? 1 : -1;
+        version++;
+        return true;
+    }
+
+    bool isWalkable(int x, int y) const {
+        if (x < 0 || y < 0 || x >= width || y >= height) {
+            return false;
+        }
+        size_t index = static_cast<size_t>(y) * width + x;
+        return (bits[index >> 6] >> (index & 63)) & 1;
+    }
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+    int getOpenCellCount() const { return openCells; }
+    uint32_t getVersion() const { return version; }
+
+private:
+    std::vector<uint64_t> bits;
+    int width = 0;
+    int height = 0;
+    int openCells = 0;
+    uint32_t version = 0;
+};
+
+NavGrid navGrid;
+
+enum class PathSearchMode {
+    AStar,
+    JumpPoint,
+    Auto
+};
+// Доля проходимых клеток, начиная с которой PathSearchMode::Auto выбирает JPS
+const float JUMP_POINT_MIN_OPEN_RATIO = 0.6f;
+
+PathSearchMode resolvePathSearchMode(const NavGrid& grid, PathSearchMode mode) {
+    if (mode != PathSearchMode::Auto) {
+        return mode;
+    }
+    float cells = static_cast<float>(grid.getWidth() * grid.getHeight());
+    return cells > 0 && grid.getOpenCellCount() / cells >= JUMP_POINT_MIN_OPEN_RATIO
+        ? PathSearchMode::JumpPoint : PathSearchMode::AStar;
+}
+
+// Равномерная пространственная хеш-сетка с шагом cellSize. Объекты хранятся по
+// 32-битному идентификатору; update переносит объект между корзинами только при
+// смене клетки, поэтому стоимость запросов зависит от локальной плотности.
+class SpatialHash {
+public:
+    void insert(uint32_t id, const sf::Vector2f& position) {
+        uint64_t key = keyFor(position);
+        entries[id] = Entry{ key, position };
+        buckets[key].push_back(id);
+    }
+
+    void update(uint32_t id, const sf::Vector2f& position) {
+        auto it = entries.find(id);
+        if (it == entries.end()) {
+            insert(id, position);
+            return;
+        }
+        uint64_t key = keyFor(position);
+        if (key != it->second.key) {
+            removeFromBucket(it->second.key, id);
+            buckets[key].push_back(id);
+            it->second.key = key;
+        }
+        it->second.position = position;
+    }
+
+    void remove(uint32_t id) {
+        auto it = entries.find(id);
+        if (it == entries.end()) return;
+        removeFromBucket(it->second.key, id);
+        entries.erase(it);
+    }
+
+    void clear() {
+        entries.clear();
+        buckets.clear();
+    }
+
+    size_t size() const { return entries.size(); }
+
+    void queryRadius(const sf::Vector2f& center, float radius, std::vector<uint32_t>& result) const {
+        result.clear();
+        float radiusSquared = radius * radius;
+        forEachInRange(center - sf::Vector2f(radius, radius), center + sf::Vector2f(radius, radius),
+            [&](uint32_t id, const sf::Vector2f& position) {
+                float dx = position.x - center.x;
+                float dy = position.y - center.y;
+                if (dx * dx + dy * dy <= radiusSquared) {
+                    result.push_back(id);
+                }
+            });
+    }
+
+    void queryAABB(const sf::FloatRect& rect, std::vector<uint32_t>& result) const {
+        result.clear();
+        forEachInRange(rect.position, rect.position + rect.size,
+            [&](uint32_t id, const sf::Vector2f& position) {
+                if (rect.contains(position)) {
+                    result.push_back(id);
+                }
+            });
+    }
+
+    // k ближайших объектов не дальше maxRadius: кольца клеток вокруг центра
+    // обходятся до тех пор, пока следующее кольцо не может дать объекта ближе
+    // k-го найденного или вообще попасть в радиус
+    void queryKNearest(const sf::Vector2f& center, size_t k, float maxRadius, std::vector<uint32_t>& result) const {
+        result.clear();
+        if (k == 0 || entries.empty()) return;
+
+        std::vector<std::pair<float, uint32_t>> candidates;
+        float maxRadiusSquared = maxRadius * maxRadius;
+        int centerX = cellCoord(center.x);
+        int centerY = cellCoord(center.y);
+        for (int ring = 0; candidates.size() < entries.size(); ++ring) {
+            for (int y = centerY - ring; y <= centerY + ring; ++y) {
+                bool edgeRow = (y == centerY - ring || y == centerY + ring);
+                int step = edgeRow ? 1 : 2 * ring;
+                for (int x = centerX - ring; x <= centerX + ring; x += std::max(step, 1)) {
+                    auto bucket = buckets.find(packKey(x, y));
+                    if (bucket == buckets.end()) continue;
+                    for (uint32_t id : bucket->second) {
+                        const sf::Vector2f& position = entries.at(id).position;
+                        float dx = position.x - center.x;
+                        float dy = position.y - center.y;
+                        float distanceSquared = dx * dx + dy * dy;
+                        if (distanceSquared <= maxRadiusSquared) {
+                            candidates.push_back({ distanceSquared, id });
+                        }
+                    }
+                }
+            }
+            float reach = ring * cellSize;
+            if (candidates.size() >= k) {
+                std::nth_element(candidates.begin(), candidates.begin() + (k - 1), candidates.end());
+                if (candidates[k - 1].first <= reach * reach) break;
+            }
+            if (reach > maxRadius) break;
+        }
+
+        size_t count = std::min(k, candidates.size());
+        std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+        for (size_t i = 0; i < count; ++i) {
+            result.push_back(candidates[i].second);
+        }
+    }
+
+private:
+    struct Entry {
+        uint64_t key;
+        sf::Vector2f position;
+    };
+
+    std::unordered_map<uint64_t, std::vector<uint32_t>> buckets;
+    std::unordered_map<uint32_t, Entry> entries;
+
+    static int cellCoord(float value) {
+        return static_cast<int>(std::floor(value / cellSize));
+    }
+
+    static uint64_t packKey(int x, int y) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+    }
+
+    static uint64_t keyFor(const sf::Vector2f& position) {
+        return packKey(cellCoord(position.x), cellCoord(position.y));
+    }
+
+    void removeFromBucket(uint64_t key, uint32_t id) {
+        auto bucket = buckets.find(key);
+        if (bucket == buckets.end()) return;
+        auto& ids = bucket->second;
+        auto it = std::find(ids.begin(), ids.end(), id);
+        if (it != ids.end()) {
+            *it = ids.back();
+            ids.pop_back();
+        }
+        if (ids.empty()) {
+            buckets.erase(bucket);
+        }
+    }
+
+    template <typename Visitor>
+    void forEachInRange(const sf::Vector2f& minCorner, const sf::Vector2f& maxCorner, Visitor visit) const {
+        int minX = cellCoord(minCorner.x);
+        int minY = cellCoord(minCorner.y);
+        int maxX = cellCoord(maxCorner.x);
+        int maxY = cellCoord(maxCorner.y);
+        for (int y = minY; y <= maxY; ++y) {
+            for (int x = minX; x <= maxX; ++x) {
+                auto bucket = buckets.find(packKey(x, y));
+                if (bucket == buckets.end()) continue;
+                for (uint32_t id : bucket->second) {
+                    visit(id, entries.at(id).position);
+                }
+            }
+        }
+    }
+};
+
+// Индекс врагов по хэндлам
+SpatialHash enemySpatialHash;
+
+// Индексы неподвижных ловушек и аптечек по тайловой сетке (id — индекс в векторе),
+// нужны только для отсечения при отрисовке
+SpatialHash trapRenderIndex;
+SpatialHash healthRenderIndex;
+
+// Враги уровня в виде структуры массивов: горячие поля (позиция, скорость, таймеры,
+// флаги) лежат плотно, отрисовка и маршруты — в отдельных холодных массивах.
+// Удаление переставляет последнего врага на место удалённого, поэтому снаружи
+// враги адресуются стабильными хэндлами (слот + поколение).
+typedef uint32_t EnemyHandle;
+
+class EnemyStore {
+public:
+    enum Flag : uint8_t {
+        STRONG = 1,
+        TO_DESTROY = 2,
+        PURSUING = 4,
+        SEEN_PLAYER = 8,
+        NEEDS_PATROL = 16,
+        NEEDS_REPATH = 32
+    };
+
+    // Горячие данные
+    std::vector<sf::Vector2f> position;
+    std::vector<sf::Vector2f> previousPosition;   // позиция на начало тика, для интерполяции
+    std::vector<b2Vec2> velocity;
+    std::vector<float> speed;
+    std::vector<int> health;
+    std::vector<float> stunTimer;
+    std::vector<float> idleTimer;
+    std::vector<float> lastSeenPlayerTime;
+    std::vector<float> patrolChangeTimer;
+    std::vector<float> recalculatePathTimer;
+    std::vector<uint32_t> currentPatrolPoint;
+    std::vector<float> aiAccumulator;
+    std::vector<uint8_t> aiTier;
+    std::vector<uint8_t> flags;
+    std::vector<b2Body*> body;
+    std::vector<EnemyHandle> handle;
+
+    // Холодные данные
+    std::vector<sf::CircleShape> shape;
+    std::vector<std::vector<sf::Vector2i>> patrolPath;
+    std::vector<std::vector<sf::Vector2i>> path;
+
+    size_t size() const { return body.size(); }
+    bool empty() const { return body.empty(); }
+
+    EnemyHandle add(b2Body* enemyBody, const sf::Vector2f& enemyPosition, float enemySpeed, int enemyHealth, bool isStrong) {
+        uint32_t slot;
+        if (!freeSlots.empty()) {
+            slot = freeSlots.back();
+            freeSlots.pop_back();
+        }
+        else {
+            slot = static_cast<uint32_t>(slotToIndex.size());
+            slotToIndex.push_back(0);
+            slotGeneration.push_back(0);
+        }
+        slotToIndex[slot] = static_cast<uint32_t>(size());
+        EnemyHandle newHandle = (slotGeneration[slot] << 16) | slot;
+
+        position.push_back(enemyPosition);
+        previousPosition.push_back(enemyPosition);
+        velocity.push_back(b2Vec2(0.0f, 0.0f));
+        speed.push_back(enemySpeed);
+        health.push_back(enemyHealth);
+        stunTimer.push_back(0.0f);
+        idleTimer.push_back(0.0f);
+        lastSeenPlayerTime.push_back(0.0f);
+        patrolChangeTimer.push_back(0.0f);
+        recalculatePathTimer.push_back(0.0f);
+        currentPatrolPoint.push_back(0);
+        aiAccumulator.push_back(0.0f);
+        aiTier.push_back(0);
+        flags.push_back(isStrong ? STRONG : 0);
+        body.push_back(enemyBody);
+        handle.push_back(newHandle);
+        shape.emplace_back();
+        patrolPath.emplace_back();
+        path.emplace_back();
+        return newHandle;
+    }
+
+    void remove(size_t index) {
+        size_t last = size() - 1;
+        uint32_t removedSlot = handle[index] & 0xFFFF;
+        if (index != last) {
+            position[index] = position[last];
+            previousPosition[index] = previousPosition[last];
+            velocity[index] = velocity[last];
+            speed[index] = speed[last];
+            health[index] = health[last];
+            stunTimer[index] = stunTimer[last];
+            idleTimer[index] = idleTimer[last];
+            lastSeenPlayerTime[index] = lastSeenPlayerTime[last];
+            patrolChangeTimer[index] = patrolChangeTimer[last];
+            recalculatePathTimer[index] = recalculatePathTimer[last];
+            currentPatrolPoint[index] = currentPatrolPoint[last];
+            aiAccumulator[index] = aiAccumulator[last];
+            aiTier[index] = aiTier[last];
+            flags[index] = flags[last];
+            body[index] = body[last];
+            handle[index] = handle[last];
+            shape[index] = std::move(shape[last]);
+            patrolPath[index] = std::move(patrolPath[last]);
+            path[index] = std::move(path[last]);
+            slotToIndex[handle[index] & 0xFFFF] = static_cast<uint32_t>(index);
+        }
+        position.pop_back();
+        previousPosition.pop_back();
+        velocity.pop_back();
+        speed.pop_back();
+        health.pop_back();
+        stunTimer.pop_back();
+        idleTimer.pop_back();
+        lastSeenPlayerTime.pop_back();
+        patrolChangeTimer.pop_back();
+        recalculatePathTimer.pop_back();
+        currentPatrolPoint.pop_back();
+        aiAccumulator.pop_back();
+        aiTier.pop_back();
+        flags.pop_back();
+        body.pop_back();
+        handle.pop_back();
+        shape.pop_back();
+        patrolPath.pop_back();
+        path.pop_back();
+
+        slotGeneration[removedSlot] = (slotGeneration[removedSlot] + 1) & 0xFFFF;
+        freeSlots.push_back(removedSlot);
+    }
+
+    // Индекс врага в массивах или -1, если хэндл устарел
+    int indexOf(EnemyHandle enemyHandle) const {
+        uint32_t slot = enemyHandle & 0xFFFF;
+        if (slot >= slotToIndex.size() || slotGeneration[slot] != (enemyHandle >> 16)) {
+            return -1;
+        }
+        return static_cast<int>(slotToIndex[slot]);
+    }
+
+    bool hasFlag(size_t index, Flag flag) const { return (flags[index] & flag) != 0; }
+
+    void setFlag(size_t index, Flag flag, bool value) {
+        if (value) flags[index] |= flag;
+        else flags[index] &= ~flag;
+    }
+
+    void clear() {
+        while (!empty()) {
+            remove(size() - 1);
+        }
+    }
+
+private:
+    std::vector<uint32_t> slotToIndex;
+    std::vector<uint32_t> slotGeneration;
+    std::vector<uint32_t> freeSlots;
 };
 
+// Переносит позицию врага из физического тела в хот-массив, фигуру и хеш-сетку
+void syncEnemyPosition(EnemyStore& enemies, size_t index) {
+    b2Body* body = enemies.body[index];
+    if (!body) return;
+    enemies.position[index] = sf::Vector2f(body->GetPosition().x, body->GetPosition().y);
+    enemies.shape[index].setPosition(enemies.position[index]);
+    enemySpatialHash.update(enemies.handle[index], enemies.position[index]);
+}
+
 struct Trap {
     sf::ConvexShape shape;
     b2Body* body;
     bool active = true;
     float rotationSpeed = 180.0f; 
+    float rotation = 0.0f;
 };
 
 // Структура пули
@@ -140,12 +562,340 @@ struct Bullet {
     sf::CircleShape shape;
     b2Body* body;  
     b2Vec2 direction;
+    sf::Vector2f previousPosition;
     float distanceTravelled = 0.0f;
     float maxDistance = 160.0f;
     bool toDestroy = false; 
+    uint32_t slot = 0;
+};
+
+// Пул пуль фиксированной ёмкости. Пули и их тела создаются один раз: свободное
+// тело выключено через SetEnabled(false) и не участвует в broadphase, выстрел
+// только переносит его на место и включает. Фильтр фикстуры задаётся при
+// создании и больше не меняется. Активные пули перечислены в active, удаление
+// переставляет последнюю на место удалённой. Активные пули лежат в
+// пространственном индексе по номеру слота.
+class BulletPool {
+public:
+    static const size_t DEFAULT_CAPACITY = 256;
+
+    explicit BulletPool(b2World& world, size_t capacity = DEFAULT_CAPACITY) : world(world), slots(capacity) {
+        active.reserve(capacity);
+        freeSlots.reserve(capacity);
+        for (size_t i = 0; i < capacity; ++i) {
+            Bullet& bullet = slots[i];
+            bullet.slot = static_cast<uint32_t>(i);
+            bullet.shape = sf::CircleShape(5.0f);
+            bullet.shape.setFillColor(sf::Color::Red);
+            bullet.shape.setOrigin(sf::Vector2f(5.0f, 5.0f));
+
+            b2BodyDef bulletDef;
+            bulletDef.type = b2_dynamicBody;
+            bulletDef.bullet = true;
+            bulletDef.enabled = false;
+            bullet.body = world.CreateBody(&bulletDef);
+
+            b2CircleShape circle;
+            circle.m_radius = 5.0f;
+
+            b2FixtureDef fixtureDef;
+            fixtureDef.shape = &circle;
+            fixtureDef.density = 1.0f;
+            fixtureDef.isSensor = false;
+            fixtureDef.filter.categoryBits = BULLET_CATEGORY;
+            fixtureDef.filter.maskBits = ENEMY_CATEGORY | WALL_CATEGORY | DOOR_CATEGORY;
+            bullet.body->CreateFixture(&fixtureDef);
+            tagFixtures(bullet.body, i);
+
+            freeSlots.push_back(static_cast<uint32_t>(capacity - 1 - i));
+        }
+    }
+
+    ~BulletPool() {
+        for (Bullet& bullet : slots) {
+            world.DestroyBody(bullet.body);
+        }
+    }
+
+    BulletPool(const BulletPool&) = delete;
+    BulletPool& operator=(const BulletPool&) = delete;
+
+    // Включает свободную пулю в точке position; nullptr, если пул исчерпан
+    Bullet* acquire(const sf::Vector2f& position, const b2Vec2& direction, float speed) {
+        if (freeSlots.empty()) {
+            exhaustedCount++;
+            return nullptr;
+        }
+        Bullet& bullet = slots[freeSlots.back()];
+        freeSlots.pop_back();
+        active.push_back(bullet.slot);
+
+        bullet.direction = direction;
+        bullet.previousPosition = position;
+        bullet.distanceTravelled = 0.0f;
+        bullet.toDestroy = false;
+        bullet.shape.setPosition(position);
+        bullet.body->SetTransform(b2Vec2(position.x, position.y), 0.0f);
+        bullet.body->SetAngularVelocity(0.0f);
+        bullet.body->SetLinearVelocity(speed * direction);
+        bullet.body->SetEnabled(true);
+        index.insert(bullet.slot, position);
+        return &bullet;
+    }
+
+    // Переносит активную пулю в индексе на текущую позицию тела
+    void updateIndex(size_t activeIndex) {
+        const Bullet& bullet = slots[active[activeIndex]];
+        index.update(bullet.slot, sf::Vector2f(bullet.body->GetPosition().x, bullet.body->GetPosition().y));
+    }
+
+    // Возвращает в пул активную пулю с номером index в списке активных
+    void release(size_t activeIndex) {
+        Bullet& bullet = slots[active[activeIndex]];
+        bullet.body->SetEnabled(false);
+        bullet.body->SetLinearVelocity(b2Vec2(0.0f, 0.0f));
+        index.remove(bullet.slot);
+        freeSlots.push_back(bullet.slot);
+        active[activeIndex] = active.back();
+        active.pop_back();
+    }
+
+    void releaseAll() {
+        while (!active.empty()) {
+            release(active.size() - 1);
+        }
+    }
+
+    size_t size() const { return active.size(); }
+    Bullet& operator[](size_t index) { return slots[active[index]]; }
+    const Bullet& operator[](size_t index) const { return slots[active[index]]; }
+    Bullet& fromSlot(uint32_t slot) { return slots[slot]; }
+    const Bullet& fromSlot(uint32_t slot) const { return slots[slot]; }
+    uint64_t getExhaustedCount() const { return exhaustedCount; }
+    const SpatialHash& getIndex() const { return index; }
+
+private:
+    b2World& world;
+    SpatialHash index;
+    std::vector<Bullet> slots;
+    std::vector<uint32_t> active;
+    std::vector<uint32_t> freeSlots;
+    uint64_t exhaustedCount = 0;
+};
+
+// Активация физики по областям: карта делится на квадраты REGION_SIZE x REGION_SIZE
+// клеток. Область включается, когда она ближе ACTIVATE_RADIUS областей к
+// областям, которые задевает камера, а выключается, только когда уходит дальше
+// DEACTIVATE_RADIUS, — разрыв между радиусами не даёт телам мигать на границе.
+// Всё видимое и всё в пределах дальности оружия (у винтовки 320 px — меньше
+// половины вида 800x600 плюс область запаса) остаётся включённым. Тела выключенных областей
+// убираются из world.Step через SetEnabled(false), враги там не думают.
+class PhysicsActivation {
+public:
+    static const int REGION_SIZE = 8;             // в клетках
+    static const int ACTIVATE_RADIUS = 1;         // в областях за пределами камеры
+    static const int DEACTIVATE_RADIUS = 2;
+
+    void build(const NavGrid& grid) {
+        regionsX = (grid.getWidth() + REGION_SIZE - 1) / REGION_SIZE;
+        regionsY = (grid.getHeight() + REGION_SIZE - 1) / REGION_SIZE;
+        regionActive.assign(static_cast<size_t>(regionsX) * regionsY, 0);
+        staticDirty = true;
+    }
+
+    // Пересчитывает области вокруг камеры. Неподвижные тела перебираются только
+    // при смене состояния какой-либо области, враги — каждый тик, так как могут
+    // перейти границу сами
+    void update(const sf::FloatRect& cameraRect, EnemyStore& enemies, std::vector<Trap>& traps,
+        std::vector<HealthPickup>& healthPickups, std::vector<Key>& keys, std::vector<Door>& doors) {
+        sf::Vector2i cameraMin = regionOf(cameraRect.position);
+        sf::Vector2i cameraMax = regionOf(cameraRect.position + cameraRect.size);
+        for (int ry = 0; ry < regionsY; ++ry) {
+            for (int rx = 0; rx < regionsX; ++rx) {
+                int dx = std::max({ 0, cameraMin.x - rx, rx - cameraMax.x });
+                int dy = std::max({ 0, cameraMin.y - ry, ry - cameraMax.y });
+                int distance = std::max(dx, dy);
+                uint8_t& active = regionActive[ry * regionsX + rx];
+                uint8_t next = active ? distance <= DEACTIVATE_RADIUS : distance <= ACTIVATE_RADIUS;
+                if (next != active) {
+                    active = next;
+                    staticDirty = true;
+                }
+            }
+        }
+
+        if (staticDirty) {
+            for (auto& trap : traps) apply(trap.body);
+            for (auto& health : healthPickups) apply(health.body);
+            for (auto& key : keys) apply(key.body);
+            for (auto& door : doors) apply(door.body);
+            staticDirty = false;
+        }
+        for (b2Body* body : enemies.body) {
+            apply(body);
+        }
+    }
+
+    bool isActive(const sf::Vector2f& position) const {
+        if (regionActive.empty()) return true;
+        sf::Vector2i region = regionOf(position);
+        return regionActive[region.y * regionsX + region.x] != 0;
+    }
+
+    int getActiveRegionCount() const {
+        return static_cast<int>(std::count(regionActive.begin(), regionActive.end(), 1));
+    }
+
+    int getRegionCount() const { return static_cast<int>(regionActive.size()); }
+
+private:
+    std::vector<uint8_t> regionActive;
+    int regionsX = 0;
+    int regionsY = 0;
+    bool staticDirty = true;
+
+    sf::Vector2i regionOf(const sf::Vector2f& position) const {
+        int x = static_cast<int>(std::floor(position.x / (cellSize * REGION_SIZE)));
+        int y = static_cast<int>(std::floor(position.y / (cellSize * REGION_SIZE)));
+        return sf::Vector2i(std::clamp(x, 0, std::max(0, regionsX - 1)), std::clamp(y, 0, std::max(0, regionsY - 1)));
+    }
+
+    void apply(b2Body* body) {
+        if (!body) return;
+        bool active = isActive(sf::Vector2f(body->GetPosition().x, body->GetPosition().y));
+        if (body->IsEnabled() != active) {
+            body->SetEnabled(active);
+            if (active) {
+                body->SetAwake(true);
+            }
+        }
+    }
+};
+
+PhysicsActivation physicsActivation;
+
+// Как оружие доставляет снаряд: динамическим телом с CCD (BulletPool) или
+// отрезком луча за тик без тела (ProjectileSystem)
+enum class ProjectileMode {
+    Body,
+    Raycast
+};
+
+struct WeaponType {
+    const char* name;
+    ProjectileMode mode;
+    float speed;
+    float maxDistance;
+    float fireInterval;
+};
+
+const WeaponType WEAPONS[] = {
+    { "pistol", ProjectileMode::Body, 60.0f, 160.0f, 0.5f },
+    { "rifle", ProjectileMode::Raycast, 300.0f, 320.0f, 0.15f }
+};
+const int WEAPON_COUNT = sizeof(WEAPONS) / sizeof(WEAPONS[0]);
+
+// Снаряды без физического тела: каждый тик снаряд проходит отрезок длиной
+// speed * dt, и b2World::RayCast ищет ближайшую фикстуру стены, двери или врага
+// на нём. Попадание разбирается сразу, CCD Box2D для таких снарядов не нужен.
+// Снаряды лежат в пространственном индексе по номеру в векторе.
+class ProjectileSystem {
+public:
+    struct Projectile {
+        sf::Vector2f position;
+        sf::Vector2f previousPosition;
+        b2Vec2 direction;
+        float speed;
+        float distanceTravelled;
+        float maxDistance;
+    };
+
+    static const uint16 HIT_MASK = ENEMY_CATEGORY | WALL_CATEGORY | DOOR_CATEGORY;
+
+    explicit ProjectileSystem(size_t capacity = 256) {
+        projectiles.reserve(capacity);
+    }
+
+    void spawn(const sf::Vector2f& position, const b2Vec2& direction, float speed, float maxDistance) {
+        index.insert(static_cast<uint32_t>(projectiles.size()), position);
+        projectiles.push_back({ position, position, direction, speed, 0.0f, maxDistance });
+    }
+
+    // Продвигает снаряды на тик; хэндлы задетых врагов дописываются в enemyHits
+    void update(b2World& world, float deltaTime, std::vector<EnemyHandle>& enemyHits) {
+        for (size_t i = 0; i < projectiles.size(); ) {
+            Projectile& projectile = projectiles[i];
+            projectile.previousPosition = projectile.position;
+
+            float step = std::min(projectile.speed * deltaTime, projectile.maxDistance - projectile.distanceTravelled);
+            bool finished = step <= 0.0f;
+            if (!finished) {
+                b2Vec2 from(projectile.position.x, projectile.position.y);
+                b2Vec2 to = from + step * projectile.direction;
+                ClosestHit hit;
+                world.RayCast(&hit, from, to);
+                if (hit.fixture) {
+                    if (entityKindOf(hit.fixture->GetFilterData().categoryBits) == EntityKind::ENEMY) {
+                        enemyHits.push_back(static_cast<EnemyHandle>(hit.fixture->GetUserData().pointer));
+                    }
+                    projectile.position = sf::Vector2f(hit.point.x, hit.point.y);
+                    finished = true;
+                }
+                else {
+                    projectile.position = sf::Vector2f(to.x, to.y);
+                    projectile.distanceTravelled += step;
+                    finished = projectile.distanceTravelled >= projectile.maxDistance;
+                }
+            }
+
+            if (finished) {
+                // Последний снаряд переезжает на место удалённого и в индексе тоже
+                uint32_t last = static_cast<uint32_t>(projectiles.size() - 1);
+                index.remove(last);
+                projectiles[i] = projectiles.back();
+                projectiles.pop_back();
+                if (i < projectiles.size()) {
+                    index.update(static_cast<uint32_t>(i), projectiles[i].position);
+                }
+            }
+            else {
+                index.update(static_cast<uint32_t>(i), projectile.position);
+                ++i;
+            }
+        }
+    }
+
+    void clear() {
+        projectiles.clear();
+        index.clear();
+    }
+
+    size_t size() const { return projectiles.size(); }
+    const Projectile& operator[](size_t projectileIndex) const { return projectiles[projectileIndex]; }
+    const SpatialHash& getIndex() const { return index; }
+
+private:
+    // Ближайшая твёрдая фикстура из HIT_MASK на луче
+    struct ClosestHit : public b2RayCastCallback {
+        b2Fixture* fixture = nullptr;
+        b2Vec2 point;
+
+        float ReportFixture(b2Fixture* candidate, const b2Vec2& hitPoint, const b2Vec2&, float fraction) override {
+            if (candidate->IsSensor() || !(candidate->GetFilterData().categoryBits & HIT_MASK)) {
+                return -1.0f;
+            }
+            fixture = candidate;
+            point = hitPoint;
+            return fraction;
+        }
+    };
+
+    std::vector<Projectile> projectiles;
+    SpatialHash index;
 };
 
-std::vector<sf::Vector2i> findPath(const sf::Vector2i& start, const sf::Vector2i& end, const std::vector<Door>& doors);
+std::vector<sf::Vector2i> findPath(const NavGrid& grid, const sf::Vector2i& start, const sf::Vector2i& end,
+    PathSearchMode mode = PathSearchMode::Auto);
 
 
 class RLAgent {
@@ -271,6 +1021,24 @@ public:
     }
 };
 
+// Общий приёмник игровых событий: обработчики контактов только складывают сюда
+// события, а LevelGenerator из main забирает их после шага мира
+class GameEventSink {
+public:
+    void record(const RLAgent::GameEvent& event) {
+        pending.push_back(event);
+    }
+
+    // Переносит накопленные события в batch и опустошает приёмник
+    void drain(std::vector<RLAgent::GameEvent>& batch) {
+        batch.clear();
+        batch.swap(pending);
+    }
+
+private:
+    std::vector<RLAgent::GameEvent> pending;
+};
+
 class LevelGenerator {
 private:
     std::vector<std::vector<std::vector<int>>> generatedLevels;
@@ -286,6 +1054,7 @@ private:
     const int BASE_HEALTH = 1;
     RLAgent rlAgent;
     std::vector<RLAgent::GameEvent> gameEvents;
+    std::vector<RLAgent::GameEvent> eventBatch;
     float totalReward = 0.0f;
     const int maxEnemies = 10;
     const int maxTraps = 5;
@@ -624,7 +1393,9 @@ private:
 
         if (!foundPlayer || !foundExit) return;
 
-        std::vector<sf::Vector2i> path = findPath(playerPos, exitPos, std::vector<Door>());
+        NavGrid grid;
+        grid.build(level, false);
+        std::vector<sf::Vector2i> path = findPath(grid, playerPos, exitPos);
         if (path.empty()) {
             for (int i = 0; i < 10; i++) { 
                 sf::Vector2i wallToRemove(
@@ -634,7 +1405,8 @@ private:
 
                 if (level[wallToRemove.y][wallToRemove.x] == WALL) {
                     level[wallToRemove.y][wallToRemove.x] = EMPTY;
-                    path = findPath(playerPos, exitPos, std::vector<Door>());
+                    grid.setWalkable(wallToRemove.x, wallToRemove.y, true);
+                    path = findPath(grid, playerPos, exitPos);
                     if (!path.empty()) break;
                 }
             }
@@ -970,6 +1742,13 @@ public:
         rlAgent.update(event);
     }
 
+    void consumeEvents(GameEventSink& sink) {
+        sink.drain(eventBatch);
+        for (const auto& event : eventBatch) {
+            recordEvent(event);
+        }
+    }
+
     void endLevelEvaluation(int levelNum, float completionTime,
         int playerDeaths, int enemiesKilled,
         int trapsTriggered, int healthPicked) {
@@ -1043,65 +1822,618 @@ void LevelGenerator::updateDifficulty(float levelTime, int playerDeaths, int ene
 };
 
 
-Wall createWall(b2World& world, const sf::Vector2f& position, const sf::Vector2f& size) {
-    Wall wall;
-    wall.shape.setSize(size);
-    wall.shape.setFillColor(sf::Color::White);
-    wall.shape.setOrigin(sf::Vector2f(size.x / 2, size.y / 2));
-    wall.shape.setPosition(position);
+// Статическая геометрия уровня: клетки WALL жадно сливаются в максимальные
+// прямоугольники (сначала вправо по строке, затем вниз), и каждый прямоугольник
+// становится одной фикстурой общего статического тела. Вместо сотни тел на
+// лабиринт в broadphase попадает несколько десятков прямоугольников.
+class StaticGeometry {
+public:
+    void build(const std::vector<std::vector<int>>& map, float cellSize, b2World& world) {
+        auto startTime = std::chrono::steady_clock::now();
+        int height = static_cast<int>(map.size());
+        int width = 0;
+        for (const auto& row : map) {
+            width = std::max(width, static_cast<int>(row.size()));
+        }
+        auto isWall = [&](int x, int y) {
+            return x < static_cast<int>(map[y].size()) && map[y][x] == WALL;
+        };
 
-    b2BodyDef wallDef;
-    wallDef.type = b2_staticBody;
-    wallDef.position.Set(position.x, position.y);
-    wall.body = world.CreateBody(&wallDef);
+        covered.assign(static_cast<size_t>(width) * height, 0);
+        wallCells = 0;
+        fixtureCount = 0;
 
-    b2PolygonShape wallBox;
-    wallBox.SetAsBox(size.x / 2, size.y / 2);
+        b2BodyDef bodyDef;
+        bodyDef.type = b2_staticBody;
+        bodyDef.position.Set(0.0f, 0.0f);
+        body = world.CreateBody(&bodyDef);
 
-    b2FixtureDef fixtureDef;
-    fixtureDef.shape = &wallBox;
-    fixtureDef.density = 0.0f;
-    fixtureDef.filter.categoryBits = WALL_CATEGORY;
-    fixtureDef.filter.maskBits = PLAYER_CATEGORY | ENEMY_CATEGORY | BULLET_CATEGORY;
-    wall.body->CreateFixture(&fixtureDef);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < width; ++x) {
+                if (!isWall(x, y) || covered[y * width + x]) continue;
 
-    return wall;
-}
+                int w = 1;
+                while (x + w < width && isWall(x + w, y) && !covered[y * width + x + w]) {
+                    w++;
+                }
+                int h = 1;
+                while (y + h < height) {
+                    bool rowFits = true;
+                    for (int i = 0; i < w && rowFits; ++i) {
+                        rowFits = isWall(x + i, y + h) && !covered[(y + h) * width + x + i];
+                    }
+                    if (!rowFits) break;
+                    h++;
+                }
+                for (int dy = 0; dy < h; ++dy) {
+                    for (int dx = 0; dx < w; ++dx) {
+                        covered[(y + dy) * width + x + dx] = 1;
+                    }
+                }
+                wallCells += w * h;
+                addRectangle(x * cellSize, y * cellSize, w * cellSize, h * cellSize);
+            }
+        }
+        tagFixtures(body, 0);
 
-Pit createPit(const sf::Vector2f& position, const sf::Vector2f& size) {
-    Pit pit;
-    pit.shape.setSize(size);
-    pit.shape.setFillColor(sf::Color::Blue);
-    pit.shape.setOrigin(sf::Vector2f(size.x / 2, size.y / 20));
-    pit.shape.setPosition(position);
-    return pit;
-}
+        float buildMs = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "Static geometry: " << wallCells << " wall cells (" << wallCells << " bodies, "
+            << wallCells << " fixtures before) -> 1 body, " << fixtureCount << " fixtures, "
+            << buildMs << " ms" << std::endl;
+    }
 
-Exit createExit(b2World& world, const sf::Vector2f& position, const sf::Vector2f& size) {
-    Exit exit;
-    exit.shape.setSize(size);
-    exit.shape.setFillColor(sf::Color::Green);
-    exit.shape.setOrigin(sf::Vector2f(size.x / 2, size.y / 2));
-    exit.shape.setPosition(position);
+    void clear(b2World& world) {
+        if (body) {
+            world.DestroyBody(body);
+            body = nullptr;
+        }
+        wallCells = 0;
+        fixtureCount = 0;
+    }
 
-    b2BodyDef exitDef;
-    exitDef.type = b2_staticBody;
-    exitDef.position.Set(position.x, position.y);
-    exit.body = world.CreateBody(&exitDef);
+    int getWallCellCount() const { return wallCells; }
+    int getFixtureCount() const { return fixtureCount; }
 
-    b2PolygonShape exitBox;
-    exitBox.SetAsBox(size.x / 2, size.y / 2);
+private:
+    b2Body* body = nullptr;
+    std::vector<uint8_t> covered;
+    int wallCells = 0;
+    int fixtureCount = 0;
+
+    void addRectangle(float left, float top, float width, float height) {
+        b2PolygonShape box;
+        box.SetAsBox(width / 2, height / 2, b2Vec2(left + width / 2, top + height / 2), 0.0f);
+
+        b2FixtureDef fixtureDef;
+        fixtureDef.shape = &box;
+        fixtureDef.density = 0.0f;
+        fixtureDef.filter.categoryBits = WALL_CATEGORY;
+        fixtureDef.filter.maskBits = PLAYER_CATEGORY | ENEMY_CATEGORY | BULLET_CATEGORY;
+        body->CreateFixture(&fixtureDef);
+        fixtureCount++;
+    }
+};
 
-    b2FixtureDef fixtureDef;
-    fixtureDef.shape = &exitBox;
-    fixtureDef.isSensor = true; 
-    fixtureDef.filter.categoryBits = EXIT_CATEGORY;
-    fixtureDef.filter.maskBits = PLAYER_CATEGORY;
-    exit.body->CreateFixture(&fixtureDef);
+StaticGeometry staticGeometry;
+
+// Спрайты атласа. Круг задан в единичном радиусе и масштабируется радиусом,
+// многоугольники повторяют фигуры из createTrap и directionArc игрока,
+// SPRITE_SOLID — сплошной белый блок для прямоугольников тайлов и HUD.
+enum SpriteId { SPRITE_SOLID = 0, SPRITE_CIRCLE, SPRITE_TRAP, SPRITE_ARROW, SPRITE_COUNT };
+
+// Атлас текстур: все примитивы один раз растеризуются белым в одну текстуру,
+// цвет задаётся вершинами. Готовый атлас кэшируется в PNG в рабочем каталоге
+// (как и rl_agent_state.txt); имя файла содержит хэш раскладки, контуров и
+// настроек растеризации, так что любое их изменение даёт новый файл, а не
+// устаревший кэш. Владеет атласом main: текстура должна умереть раньше окна.
+class SpriteAtlas {
+public:
+    static const int CELL_SIZE = 64;
+    static const int PADDING = 2;
+    static const int CIRCLE_POINTS = 64;
+    static const unsigned int ANTIALIASING_LEVEL = 4;
+
+    struct Region {
+        sf::FloatRect texture;     // в пикселях атласа
+        sf::FloatRect local;       // в единицах фигуры, вместе с полями
+    };
+
+    SpriteAtlas() {
+        outlines[SPRITE_CIRCLE].reserve(CIRCLE_POINTS);
+        for (int i = 0; i < CIRCLE_POINTS; ++i) {
+            float angle = 2.0f * b2_pi * i / CIRCLE_POINTS;
+            outlines[SPRITE_CIRCLE].push_back(sf::Vector2f(std::cos(angle), std::sin(angle)));
+        }
+        outlines[SPRITE_TRAP] = { sf::Vector2f(0, -10), sf::Vector2f(8, 10), sf::Vector2f(-8, 10) };
+        outlines[SPRITE_ARROW] = { sf::Vector2f(0.0f, -16.0f), sf::Vector2f(8.0f, 0.0f), sf::Vector2f(-8.0f, 0.0f) };
+
+        // Раскладка не зависит от загрузки текстуры: координаты нужны тайлам и HUD сразу
+        float inner = static_cast<float>(CELL_SIZE - 2 * PADDING);
+        for (int id = 0; id < SPRITE_COUNT; ++id) {
+            Region& region = regions[id];
+            region.texture = sf::FloatRect(sf::Vector2f(static_cast<float>(id * CELL_SIZE), 0.0f),
+                sf::Vector2f(static_cast<float>(CELL_SIZE), static_cast<float>(CELL_SIZE)));
+            if (outlines[id].empty()) {
+                region.local = sf::FloatRect(sf::Vector2f(-0.5f, -0.5f), sf::Vector2f(1.0f, 1.0f));
+                continue;
+            }
+            sf::Vector2f low = outlines[id][0];
+            sf::Vector2f high = outlines[id][0];
+            for (const sf::Vector2f& point : outlines[id]) {
+                low = sf::Vector2f(std::min(low.x, point.x), std::min(low.y, point.y));
+                high = sf::Vector2f(std::max(high.x, point.x), std::max(high.y, point.y));
+            }
+            sf::Vector2f size = high - low;
+            sf::Vector2f padding(PADDING * size.x / inner, PADDING * size.y / inner);
+            region.local = sf::FloatRect(low - padding, size + 2.0f * padding);
+        }
+
+        // FNV-1a по всему, что влияет на пиксели атласа
+        cacheKey = 2166136261u;
+        auto mix = [this](int32_t value) {
+            for (int byte = 0; byte < 4; ++byte) {
+                cacheKey = (cacheKey ^ ((static_cast<uint32_t>(value) >> (byte * 8)) & 0xFF)) * 16777619u;
+            }
+        };
+        mix(CELL_SIZE);
+        mix(PADDING);
+        mix(static_cast<int32_t>(ANTIALIASING_LEVEL));
+        mix(SPRITE_COUNT);
+        for (const auto& outline : outlines) {
+            mix(static_cast<int32_t>(outline.size()));
+            for (const sf::Vector2f& point : outline) {
+                mix(static_cast<int32_t>(std::lround(point.x * 1024.0f)));
+                mix(static_cast<int32_t>(std::lround(point.y * 1024.0f)));
+            }
+        }
+    }
+
+    SpriteAtlas(const SpriteAtlas&) = delete;
+    SpriteAtlas& operator=(const SpriteAtlas&) = delete;
+
+    std::string getCachePath() const {
+        static const char* DIGITS = "0123456789abcdef";
+        std::string path = "sprite_atlas_";
+        for (int shift = 28; shift >= 0; shift -= 4) {
+            path += DIGITS[(cacheKey >> shift) & 0xF];
+        }
+        return path + ".png";
+    }
+
+    // Загружает атлас из кэша или растеризует его; нужен активный контекст OpenGL
+    bool load() {
+        std::string cachePath = getCachePath();
+        sf::Vector2u expectedSize(static_cast<unsigned int>(SPRITE_COUNT * CELL_SIZE), static_cast<unsigned int>(CELL_SIZE));
+        sf::Image image;
+        auto startTime = std::chrono::steady_clock::now();
+        bool cached = image.loadFromFile(cachePath) && image.getSize() == expectedSize;
+        if (!cached) {
+            if (!rasterize(expectedSize, image)) {
+                std::cerr << "Failed to rasterize sprite atlas" << std::endl;
+                return false;
+            }
+            if (!image.saveToFile(cachePath)) {
+                std::cerr << "Failed to cache sprite atlas to " << cachePath << std::endl;
+            }
+        }
+        if (!texture.loadFromImage(image)) {
+            std::cerr << "Failed to upload sprite atlas" << std::endl;
+            return false;
+        }
+        texture.setSmooth(true);
+        float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+        std::cout << "Sprite atlas " << (cached ? "loaded from cache" : "rasterized") << " in " << ms << " ms" << std::endl;
+        return true;
+    }
+
+    const sf::Texture& getTexture() const { return texture; }
+    const Region& getRegion(SpriteId id) const { return regions[id]; }
+
+    // Точка внутри сплошного блока: прямоугольники сэмплируют только её
+    sf::Vector2f getSolidTexCoord() const {
+        return regions[SPRITE_SOLID].texture.position + regions[SPRITE_SOLID].texture.size / 2.0f;
+    }
+
+private:
+    std::array<Region, SPRITE_COUNT> regions;
+    std::array<std::vector<sf::Vector2f>, SPRITE_COUNT> outlines;
+    uint32_t cacheKey = 0;
+    sf::Texture texture;
+
+    bool rasterize(const sf::Vector2u& size, sf::Image& image) const {
+        sf::ContextSettings settings;
+        settings.antiAliasingLevel = ANTIALIASING_LEVEL;
+        sf::RenderTexture target;
+        if (!target.resize(size, settings)) {
+            return false;
+        }
+        target.clear(sf::Color::Transparent);
+        for (int id = 0; id < SPRITE_COUNT; ++id) {
+            const Region& region = regions[id];
+            if (outlines[id].empty()) {
+                sf::RectangleShape block(region.texture.size);
+                block.setPosition(region.texture.position);
+                block.setFillColor(sf::Color::White);
+                target.draw(block);
+                continue;
+            }
+            sf::Vector2f scale(region.texture.size.x / region.local.size.x, region.texture.size.y / region.local.size.y);
+            sf::ConvexShape shape(outlines[id].size());
+            for (size_t i = 0; i < outlines[id].size(); ++i) {
+                sf::Vector2f local = outlines[id][i] - region.local.position;
+                shape.setPoint(i, region.texture.position + sf::Vector2f(local.x * scale.x, local.y * scale.y));
+            }
+            shape.setFillColor(sf::Color::White);
+            target.draw(shape);
+        }
+        target.display();
+        image = target.getTexture().copyToImage();
+        return true;
+    }
+};
+
+// Неподвижный слой уровня (выход, стены, ямы, ключи, двери), запечённый в
+// треугольники sf::VertexArray по чанкам CHUNK_SIZE x CHUNK_SIZE клеток.
+// Рисуются только чанки, пересекающие вид; подобранный ключ или открытая дверь
+// помечают грязным один чанк, и он пересобирается перед следующей отрисовкой.
+// Клетки — квадраты со сплошным блоком атласа, так что слой делит текстуру с
+// сущностями; чанки запекаются при первой отрисовке, когда атлас уже известен.
+// Слой меняется из потока симуляции, а рисуется из потока отрисовки, поэтому
+// все три операции идут под mutex.
+class TileRenderer {
+public:
+    static const int CHUNK_SIZE = 16;             // в клетках
+
+    void build(const std::vector<std::vector<int>>& map) {
+        std::lock_guard<std::mutex> lock(mutex);
+        height = static_cast<int>(map.size());
+        width = 0;
+        for (const auto& row : map) {
+            width = std::max(width, static_cast<int>(row.size()));
+        }
+        tiles.assign(static_cast<size_t>(width) * height, EMPTY);
+        for (int y = 0; y < height; ++y) {
+            for (int x = 0; x < static_cast<int>(map[y].size()); ++x) {
+                tiles[y * width + x] = static_cast<uint8_t>(map[y][x]);
+            }
+        }
+
+        chunksX = (width + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        chunksY = (height + CHUNK_SIZE - 1) / CHUNK_SIZE;
+        Chunk fresh;
+        fresh.dirty = true;
+        chunks.assign(static_cast<size_t>(chunksX) * chunksY, fresh);
+    }
+
+    // Меняет содержимое клетки (ключ подобран, дверь открыта) и помечает её чанк
+    void setTile(const sf::Vector2i& cell, int type) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (cell.x < 0 || cell.y < 0 || cell.x >= width || cell.y >= height) return;
+        tiles[cell.y * width + cell.x] = static_cast<uint8_t>(type);
+        chunks[(cell.y / CHUNK_SIZE) * chunksX + cell.x / CHUNK_SIZE].dirty = true;
+    }
+
+    void draw(sf::RenderTarget& target, const sf::View& view, const SpriteAtlas& atlas) {
+        std::lock_guard<std::mutex> lock(mutex);
+        solidTexCoord = atlas.getSolidTexCoord();
+        sf::FloatRect viewRect(view.getCenter() - view.getSize() / 2.0f, view.getSize());
+        float chunkExtent = CHUNK_SIZE * cellSize;
+        int minX = std::max(0, static_cast<int>(std::floor(viewRect.position.x / chunkExtent)));
+        int minY = std::max(0, static_cast<int>(std::floor(viewRect.position.y / chunkExtent)));
+        int maxX = std::min(chunksX - 1, static_cast<int>(std::floor((viewRect.position.x + viewRect.size.x) / chunkExtent)));
+        int maxY = std::min(chunksY - 1, static_cast<int>(std::floor((viewRect.position.y + viewRect.size.y) / chunkExtent)));
+
+        drawCalls = 0;
+        for (int cy = minY; cy <= maxY; ++cy) {
+            for (int cx = minX; cx <= maxX; ++cx) {
+                Chunk& chunk = chunks[cy * chunksX + cx];
+                if (chunk.dirty) {
+                    rebuildChunk(cx, cy);
+                }
+                if (chunk.vertices.getVertexCount() > 0) {
+                    target.draw(chunk.vertices, &atlas.getTexture());
+                    drawCalls++;
+                }
+            }
+        }
+    }
+
+    int getChunkCount() const { return static_cast<int>(chunks.size()); }
+    int getDrawCallCount() const { return drawCalls; }
+
+private:
+    struct Chunk {
+        sf::VertexArray vertices{ sf::PrimitiveType::Triangles };
+        bool dirty = false;
+    };
+
+    std::mutex mutex;
+    std::vector<uint8_t> tiles;
+    std::vector<Chunk> chunks;
+    int width = 0;
+    int height = 0;
+    int chunksX = 0;
+    int chunksY = 0;
+    int drawCalls = 0;
+    sf::Vector2f solidTexCoord;
+
+    void appendQuad(sf::VertexArray& vertices, const sf::Vector2f& topLeft, const sf::Vector2f& size, sf::Color color) {
+        sf::Vector2f topRight(topLeft.x + size.x, topLeft.y);
+        sf::Vector2f bottomLeft(topLeft.x, topLeft.y + size.y);
+        sf::Vector2f bottomRight(topLeft.x + size.x, topLeft.y + size.y);
+        vertices.append(sf::Vertex{ topLeft, color, solidTexCoord });
+        vertices.append(sf::Vertex{ topRight, color, solidTexCoord });
+        vertices.append(sf::Vertex{ bottomRight, color, solidTexCoord });
+        vertices.append(sf::Vertex{ topLeft, color, solidTexCoord });
+        vertices.append(sf::Vertex{ bottomRight, color, solidTexCoord });
+        vertices.append(sf::Vertex{ bottomLeft, color, solidTexCoord });
+    }
+
+    // Слои идут в прежнем порядке отрисовки: выход, стены, ямы, ключи, двери.
+    // Размеры и смещения повторяют фигуры из createExit/createKey/createDoor; стены
+    // и ямы существуют только здесь (физика стен — в StaticGeometry)
+    void rebuildChunk(int cx, int cy) {
+        static const int LAYERS[] = { EXIT, WALL, PIT, KEY, DOOR };
+        Chunk& chunk = chunks[cy * chunksX + cx];
+        chunk.vertices.clear();
+        chunk.dirty = false;
+
+        int startX = cx * CHUNK_SIZE;
+        int startY = cy * CHUNK_SIZE;
+        int endX = std::min(width, startX + CHUNK_SIZE);
+        int endY = std::min(height, startY + CHUNK_SIZE);
+        for (int layer : LAYERS) {
+            for (int y = startY; y < endY; ++y) {
+                for (int x = startX; x < endX; ++x) {
+                    if (tiles[y * width + x] != layer) continue;
+                    sf::Vector2f cellOrigin(x * cellSize, y * cellSize);
+                    sf::Vector2f center = cellOrigin + sf::Vector2f(cellSize / 2, cellSize / 2);
+                    switch (layer) {
+                    case EXIT:
+                        appendQuad(chunk.vertices, cellOrigin, sf::Vector2f(cellSize, cellSize), sf::Color::Green);
+                        break;
+                    case WALL:
+                        appendQuad(chunk.vertices, cellOrigin, sf::Vector2f(cellSize, cellSize), sf::Color::White);
+                        break;
+                    case PIT:
+                        appendQuad(chunk.vertices, center - sf::Vector2f(cellSize / 2, cellSize / 20),
+                            sf::Vector2f(cellSize, cellSize), sf::Color::Blue);
+                        break;
+                    case KEY:
+                        appendQuad(chunk.vertices, center - sf::Vector2f(5.0f, 10.0f), sf::Vector2f(10.0f, 20.0f),
+                            sf::Color::Yellow);
+                        break;
+                    case DOOR:
+                        appendQuad(chunk.vertices, cellOrigin, sf::Vector2f(cellSize, cellSize), sf::Color(139, 69, 19));
+                        break;
+                    }
+                }
+            }
+        }
+    }
+};
+
+TileRenderer tileRenderer;
+
+// Пакетная отрисовка подвижных сущностей: за кадр каждая сущность пишется
+// текстурированным квадом области атласа в один sf::VertexArray и уходит одним
+// draw. Поворот и масштаб применяются к четырём углам квада при записи.
+class EntityBatch {
+public:
+    explicit EntityBatch(const SpriteAtlas& atlas) : atlas(atlas) {}
+
+    void begin() {
+        vertices.clear();
+    }
+
+    // Квад спрайта id: локальные границы области масштабируются, поворачиваются
+    // и сдвигаются в position; для круга scale — радиус
+    void addSprite(SpriteId id, const sf::Vector2f& position, float rotationDegrees, sf::Color color, float scale = 1.0f) {
+        const SpriteAtlas::Region& region = atlas.getRegion(id);
+        float radians = rotationDegrees * b2_pi / 180.0f;
+        float c = std::cos(radians);
+        float s = std::sin(radians);
+        auto place = [&](const sf::Vector2f& corner) {
+            sf::Vector2f local = corner * scale;
+            return position + sf::Vector2f(local.x * c - local.y * s, local.x * s + local.y * c);
+        };
+        sf::Vector2f low = region.local.position;
+        sf::Vector2f high = low + region.local.size;
+        sf::Vector2f texLow = region.texture.position;
+        sf::Vector2f texHigh = texLow + region.texture.size;
+        sf::Vertex topLeft{ place(low), color, texLow };
+        sf::Vertex topRight{ place(sf::Vector2f(high.x, low.y)), color, sf::Vector2f(texHigh.x, texLow.y) };
+        sf::Vertex bottomRight{ place(high), color, texHigh };
+        sf::Vertex bottomLeft{ place(sf::Vector2f(low.x, high.y)), color, sf::Vector2f(texLow.x, texHigh.y) };
+        vertices.append(topLeft);
+        vertices.append(topRight);
+        vertices.append(bottomRight);
+        vertices.append(topLeft);
+        vertices.append(bottomRight);
+        vertices.append(bottomLeft);
+    }
+
+    void draw(sf::RenderTarget& target) const {
+        if (vertices.getVertexCount() > 0) {
+            target.draw(vertices, &atlas.getTexture());
+        }
+    }
+
+    size_t getVertexCount() const { return vertices.getVertexCount(); }
+
+private:
+    const SpriteAtlas& atlas;
+    sf::VertexArray vertices{ sf::PrimitiveType::Triangles };
+};
+
+// Счётчики отсечения по слоям за последний кадр
+struct RenderStats {
+    enum Layer { TILE_CHUNKS = 0, HEALTH, TRAPS, ENEMIES, BULLETS, PROJECTILES, LAYER_COUNT };
+
+    std::array<int, LAYER_COUNT> drawn{};
+    std::array<int, LAYER_COUNT> total{};
+    float simFrameMs = 0.0f;
+    float renderFrameMs = 0.0f;
+
+    void set(Layer layer, int drawnCount, int totalCount) {
+        drawn[layer] = drawnCount;
+        total[layer] = totalCount;
+    }
+
+    // Строки «СЛОЙ нарисовано/всего» и время кадров в мс с одним знаком;
+    // только символы, которые есть в растровом шрифте DebugOverlay
+    std::string describe() const {
+        static const char* NAMES[LAYER_COUNT] = { "TILE CHUNKS", "HEALTH", "TRAPS", "ENEMIES", "BULLETS", "PROJECTILES" };
+        std::string text;
+        for (int layer = 0; layer < LAYER_COUNT; ++layer) {
+            text += std::string(NAMES[layer]) + " " + std::to_string(drawn[layer]) + "/" +
+                std::to_string(total[layer]) + "\n";
+        }
+        text += "SIM MS " + formatTenths(simFrameMs) + "\n";
+        text += "RENDER MS " + formatTenths(renderFrameMs) + "\n";
+        return text;
+    }
+
+    static std::string formatTenths(float value) {
+        long tenths = std::lround(std::max(0.0f, value) * 10.0f);
+        return std::to_string(tenths / 10) + "." + std::to_string(tenths % 10);
+    }
+};
+
+// Отладочный оверлей (F3) со счётчиками отсечения. Шрифта в репозитории нет,
+// поэтому строки рисуются встроенным растровым шрифтом 3x5: каждый пиксель
+// глифа — квад сплошного блока атласа, весь оверлей уходит одним draw.
+class DebugOverlay {
+public:
+    static constexpr float PIXEL_SIZE = 2.0f;
+
+    explicit DebugOverlay(const SpriteAtlas& atlas) : atlas(atlas) {}
+
+    void setVisible(bool value) {
+        visible = value;
+    }
+
+    void draw(sf::RenderTarget& target, const RenderStats& stats) {
+        if (!visible) return;
+        std::string text = stats.describe();
+        vertices.clear();
+
+        int columns = 0;
+        int rows = 0;
+        int column = 0;
+        for (char c : text) {
+            if (c == '\n') {
+                rows++;
+                column = 0;
+                continue;
+            }
+            columns = std::max(columns, ++column);
+        }
+        float advance = 4.0f * PIXEL_SIZE;
+        float lineHeight = 7.0f * PIXEL_SIZE;
+        appendPixel(ORIGIN - sf::Vector2f(PIXEL_SIZE, PIXEL_SIZE) * 2.0f,
+            sf::Vector2f(columns * advance + 3.0f * PIXEL_SIZE, rows * lineHeight + 3.0f * PIXEL_SIZE),
+            sf::Color(0, 0, 0, 160));
+
+        sf::Vector2f pen = ORIGIN;
+        for (char c : text) {
+            if (c == '\n') {
+                pen = sf::Vector2f(ORIGIN.x, pen.y + lineHeight);
+                continue;
+            }
+            uint16_t bits = glyph(c);
+            for (int bit = 0; bit < 15; ++bit) {
+                if (bits & (1 << (14 - bit))) {
+                    sf::Vector2f offset((bit % 3) * PIXEL_SIZE, (bit / 3) * PIXEL_SIZE);
+                    appendPixel(pen + offset, sf::Vector2f(PIXEL_SIZE, PIXEL_SIZE), sf::Color::White);
+                }
+            }
+            pen.x += advance;
+        }
+        target.draw(vertices, &atlas.getTexture());
+    }
+
+private:
+    static inline const sf::Vector2f ORIGIN{ 10.0f, 40.0f };
+
+    const SpriteAtlas& atlas;
+    sf::VertexArray vertices{ sf::PrimitiveType::Triangles };
+    bool visible = false;
+
+    // Строки глифа сверху вниз по три бита, старший бит — левый столбец
+    static uint16_t glyph(char c) {
+        switch (c) {
+        case '0': return 0b111'101'101'101'111;
+        case '1': return 0b010'110'010'010'111;
+        case '2': return 0b111'001'111'100'111;
+        case '3': return 0b111'001'111'001'111;
+        case '4': return 0b101'101'111'001'001;
+        case '5': return 0b111'100'111'001'111;
+        case '6': return 0b111'100'111'101'111;
+        case '7': return 0b111'001'001'001'001;
+        case '8': return 0b111'101'111'101'111;
+        case '9': return 0b111'101'111'001'111;
+        case '/': return 0b001'001'010'100'100;
+        case '.': return 0b000'000'000'000'010;
+        case 'A': return 0b010'101'111'101'101;
+        case 'B': return 0b110'101'110'101'110;
+        case 'C': return 0b111'100'100'100'111;
+        case 'D': return 0b110'101'101'101'110;
+        case 'E': return 0b111'100'111'100'111;
+        case 'H': return 0b101'101'111'101'101;
+        case 'I': return 0b111'010'010'010'111;
+        case 'J': return 0b001'001'001'101'111;
+        case 'K': return 0b101'101'110'101'101;
+        case 'L': return 0b100'100'100'100'111;
+        case 'M': return 0b101'111'111'101'101;
+        case 'N': return 0b110'101'101'101'101;
+        case 'O': return 0b111'101'101'101'111;
+        case 'P': return 0b111'101'111'100'100;
+        case 'R': return 0b110'101'110'101'101;
+        case 'S': return 0b111'100'111'001'111;
+        case 'T': return 0b111'010'010'010'010;
+        case 'U': return 0b101'101'101'101'111;
+        default: return 0;
+        }
+    }
+
+    void appendPixel(const sf::Vector2f& topLeft, const sf::Vector2f& size, sf::Color color) {
+        sf::Vector2f texCoord = atlas.getSolidTexCoord();
+        sf::Vector2f bottomRight = topLeft + size;
+        vertices.append(sf::Vertex{ topLeft, color, texCoord });
+        vertices.append(sf::Vertex{ sf::Vector2f(bottomRight.x, topLeft.y), color, texCoord });
+        vertices.append(sf::Vertex{ bottomRight, color, texCoord });
+        vertices.append(sf::Vertex{ topLeft, color, texCoord });
+        vertices.append(sf::Vertex{ bottomRight, color, texCoord });
+        vertices.append(sf::Vertex{ sf::Vector2f(topLeft.x, bottomRight.y), color, texCoord });
+    }
+};
+
+Exit createExit(b2World& world, const sf::Vector2f& position, const sf::Vector2f& size) {
+    Exit exit;
+    exit.shape.setSize(size);
+    exit.shape.setFillColor(sf::Color::Green);
+    exit.shape.setOrigin(sf::Vector2f(size.x / 2, size.y / 2));
+    exit.shape.setPosition(position);
+
+    b2BodyDef exitDef;
+    exitDef.type = b2_staticBody;
+    exitDef.position.Set(position.x, position.y);
+    exit.body = world.CreateBody(&exitDef);
+
+    b2PolygonShape exitBox;
+    exitBox.SetAsBox(size.x / 2, size.y / 2);
+
+    b2FixtureDef fixtureDef;
+    fixtureDef.shape = &exitBox;
+    fixtureDef.isSensor = true; 
+    fixtureDef.filter.categoryBits = EXIT_CATEGORY;
+    fixtureDef.filter.maskBits = PLAYER_CATEGORY;
+    exit.body->CreateFixture(&fixtureDef);
 
     return exit;
 }
-HealthPickup createHealthPickup(b2World& world, const sf::Vector2f& position) {
+HealthPickup createHealthPickup(b2World& world, const sf::Vector2f& position, uint32_t id) {
     HealthPickup health;
     health.shape = sf::CircleShape(10.0f, 30);
     health.shape.setFillColor(sf::Color::Red);
@@ -1125,11 +2457,12 @@ HealthPickup createHealthPickup(b2World& world, const sf::Vector2f& position) {
     fixtureDef.filter.categoryBits = HEALTH_CATEGORY;
     fixtureDef.filter.maskBits = PLAYER_CATEGORY; 
     health.body->CreateFixture(&fixtureDef);
+    tagFixtures(health.body, id);
 
     return health;
 }
 
-Trap createTrap(b2World& world, const sf::Vector2f& position) {
+Trap createTrap(b2World& world, const sf::Vector2f& position, uint32_t id) {
     Trap trap;
     trap.shape.setPointCount(3);
     trap.shape.setPoint(0, sf::Vector2f(0, -10));
@@ -1158,16 +2491,18 @@ Trap createTrap(b2World& world, const sf::Vector2f& position) {
     fixtureDef.filter.categoryBits = TRAP_CATEGORY;
     fixtureDef.filter.maskBits = PLAYER_CATEGORY;
     trap.body->CreateFixture(&fixtureDef);
+    tagFixtures(trap.body, id);
 
     return trap;
 }
 
-Key createKey(b2World& world, const sf::Vector2f& position) {
+Key createKey(b2World& world, const sf::Vector2f& position, uint32_t id) {
     Key key;
     key.shape.setSize(sf::Vector2f(10.0f, 20.0f));
     key.shape.setFillColor(sf::Color::Yellow);
     key.shape.setOrigin(sf::Vector2f(5.0f, 10.0f));
     key.shape.setPosition(position);
+    key.cell = sf::Vector2i(static_cast<int>(position.x / cellSize), static_cast<int>(position.y / cellSize));
 
     b2BodyDef keyDef;
     keyDef.type = b2_staticBody;
@@ -1183,17 +2518,19 @@ Key createKey(b2World& world, const sf::Vector2f& position) {
     fixtureDef.filter.categoryBits = KEY_CATEGORY;
     fixtureDef.filter.maskBits = PLAYER_CATEGORY;
     key.body->CreateFixture(&fixtureDef);
+    tagFixtures(key.body, id);
 
     return key;
 }
 
 // Функция создания двери
-Door createDoor(b2World& world, const sf::Vector2f& position, const sf::Vector2f& size) {
+Door createDoor(b2World& world, const sf::Vector2f& position, const sf::Vector2f& size, uint32_t id) {
     Door door;
     door.shape.setSize(size);
     door.shape.setFillColor(sf::Color(139, 69, 19)); 
     door.shape.setOrigin(sf::Vector2f(size.x / 2, size.y / 2));
     door.shape.setPosition(position);
+    door.cell = sf::Vector2i(static_cast<int>(position.x / cellSize), static_cast<int>(position.y / cellSize));
 
     b2BodyDef doorDef;
     doorDef.type = b2_staticBody;
@@ -1205,33 +2542,23 @@ Door createDoor(b2World& world, const sf::Vector2f& position, const sf::Vector2f
     b2FixtureDef fixtureDef;
     fixtureDef.shape = &doorShape;
     fixtureDef.density = 0.0f;
-    fixtureDef.filter.categoryBits = WALL_CATEGORY;
+    fixtureDef.filter.categoryBits = DOOR_CATEGORY;
     fixtureDef.filter.maskBits = PLAYER_CATEGORY | ENEMY_CATEGORY | BULLET_CATEGORY;
     door.body->CreateFixture(&fixtureDef);
+    tagFixtures(door.body, id);
 
     return door;
 }
 
-bool isWalkable(int x, int y, const std::vector<Door>& doors) {
-    if (x < 0 || y < 0 || x >= currentLevelMap[0].size() || y >= currentLevelMap.size())
-        return false;
-    for (const auto& door : doors) {
-        sf::Vector2f doorPos = door.shape.getPosition();
-        int doorX = static_cast<int>(doorPos.x / cellSize);
-        int doorY = static_cast<int>(doorPos.y / cellSize);
-
-        if (doorX == x && doorY == y && !door.opened) {
-            return false;
-        }
-    }
-
-    return currentLevelMap[y][x] != WALL && currentLevelMap[y][x] != PIT;
+bool isWalkable(int x, int y) {
+    return navGrid.isWalkable(x, y);
 }
 
-std::vector<sf::Vector2i> findPath(const sf::Vector2i& start, const sf::Vector2i& end, const std::vector<Door>& doors) {
+// Прежняя реализация A* (линейный поиск по openList), оставлена для сверки в бенчмарке
+std::vector<sf::Vector2i> findPathReference(const sf::Vector2i& start, const sf::Vector2i& end) {
     std::vector<sf::Vector2i> path;
 
-    if (!isWalkable(end.x, end.y, doors)) {
+    if (!isWalkable(end.x, end.y)) {
         return path;
     }
 
@@ -1271,7 +2598,7 @@ std::vector<sf::Vector2i> findPath(const sf::Vector2i& start, const sf::Vector2i
         for (const auto& dir : directions) {
             int newX = current->x + dir.x;
             int newY = current->y + dir.y;
-            if (!isWalkable(newX, newY, doors) || closedMap[newX][newY]) {
+            if (!isWalkable(newX, newY) || closedMap[newX][newY]) {
                 continue;
             }
 
@@ -1303,234 +2630,1592 @@ std::vector<sf::Vector2i> findPath(const sf::Vector2i& start, const sf::Vector2i
     return path;
 }
 
-std::vector<sf::Vector2i> createPatrolPath(int startX, int startY, const std::vector<Door>& doors) {
-    std::vector<sf::Vector2i> path;
-    const int maxPatrolPoints = 3 + rand() % 3;
-    const int maxAttempts = 20; 
-
-    int currentX = startX;
-    int currentY = startY;
-    path.emplace_back(currentX, currentY);
-
-    for (int i = 1; i < maxPatrolPoints; ++i) {
-        int attempts = 0;
-        while (attempts < maxAttempts) {
-            int dir = rand() % 6; 
+// A* по плоским массивам клеток: индексированная двоичная куча с decrease-key,
+// g/parent/состояние переиспользуются между запросами через номер поколения.
+// Порядок извлечения (f, затем порядок вставки) совпадает с findPathReference,
+// поэтому форма пути та же самая.
+class PathFinder {
+public:
+    bool findPath(const NavGrid& grid, const sf::Vector2i& start, const sf::Vector2i& end,
+        std::vector<sf::Vector2i>& path) {
+        path.clear();
+        lastExpansions = 0;
+        if (!grid.isWalkable(end.x, end.y)) {
+            return false;
+        }
 
-            if (i > 1 && dir >= 4) {
-                sf::Vector2i prevDir = path[i - 1] - path[i - 2];
-                if (prevDir.x != 0 || prevDir.y != 0) {
-                    path.emplace_back(path.back().x + prevDir.x, path.back().y + prevDir.y);
-                    break;
+        width = grid.getWidth();
+        height = grid.getHeight();
+        if (start.x < 0 || start.y < 0 || start.x >= width || start.y >= height) {
+            return false;
+        }
+        beginQuery();
+
+        int startIndex = start.y * width + start.x;
+        int endIndex = end.y * width + end.x;
+        touch(startIndex);
+        g[startIndex] = 0.0f;
+        f[startIndex] = 0.0f;
+        parent[startIndex] = -1;
+        push(startIndex);
+
+        const int dx[4] = { 0, 1, 0, -1 };
+        const int dy[4] = { 1, 0, -1, 0 };
+
+        while (!heap.empty()) {
+            int current = pop();
+            state[current] = CLOSED;
+            lastExpansions++;
+
+            if (current == endIndex) {
+                for (int node = current; node != -1; node = parent[node]) {
+                    path.emplace_back(node % width, node / width);
                 }
+                std::reverse(path.begin(), path.end());
+                return true;
             }
 
-            int newX = currentX;
-            int newY = currentY;
-
-            switch (dir % 4) {
-            case 0: newY--; break;
-            case 1: newX++; break;
-            case 2: newY++; break; 
-            case 3: newX--; break; 
-            }
-
-            if (i > 1 && newX == path[i - 2].x && newY == path[i - 2].y) {
-                attempts++;
-                continue;
-            }
-
-            if (isWalkable(newX, newY, doors)) {
-                path.emplace_back(newX, newY);
-                currentX = newX;
-                currentY = newY;
-                break;
-            }
-            attempts++;
-        }
-        if (attempts >= maxAttempts) {
-            break;
-        }
-    }
-
-    return path;
-}
-
-
-class ContactListener : public b2ContactListener {
-    std::vector<Bullet*>& bullets;
-    std::vector<Enemy*>& enemies;
-    std::vector<Trap>& traps;
-    Player& player;
-    Exit& exit;
-    std::vector<HealthPickup>& healthPickups;
-    bool& levelCompleted;
-    b2World& world;
-    std::vector<Key>& keys;
-    std::vector<Door>& doors;
-    int& playerDeaths;
-    int& enemiesKilled;
-    int& trapsTriggered;
-    int& healthPicked;
-
-public:
-    ContactListener(std::vector<Bullet*>& bullets, std::vector<Enemy*>& enemies,
-        Player& player, Exit& exit, std::vector<HealthPickup>& healthPickups, bool& levelCompleted, b2World& world, std::vector<Trap>& traps, std::vector<Key>& keys, std::vector<Door>& doors, int& pd, int& ek, int& tt, int& hp)
-        : bullets(bullets), enemies(enemies), player(player),
-        exit(exit), healthPickups(healthPickups), levelCompleted(levelCompleted), world(world), traps(traps), keys(keys), doors(doors), playerDeaths(pd), enemiesKilled(ek), trapsTriggered(tt), healthPicked(hp) {}
-
-    ContactListener& operator=(const ContactListener&) = delete;
-    LevelGenerator levelGenerator;
-    void BeginContact(b2Contact* contact) override {
-        b2Fixture* fixtureA = contact->GetFixtureA();
-        b2Fixture* fixtureB = contact->GetFixtureB();
+            int cx = current % width;
+            int cy = current / width;
+            for (int i = 0; i < 4; ++i) {
+                int newX = cx + dx[i];
+                int newY = cy + dy[i];
+                if (newX < 0 || newY < 0 || newX >= width || newY >= height) {
+                    continue;
+                }
+                int next = newY * width + newX;
+                touch(next);
+                if (state[next] == CLOSED || !grid.isWalkable(newX, newY)) {
+                    continue;
+                }
 
-        auto createEvent = [this](const std::string& type, float reward, sf::Vector2f pos) {
-            RLAgent::GameEvent event;
-            event.type = type;
-            event.reward = reward;
-            event.position = pos;
-            levelGenerator.recordEvent(event);
-            };
-        for (auto* bullet : bullets) {
-            b2Fixture* bulletFixture = bullet->body->GetFixtureList();
-
-            if (fixtureA == bulletFixture || fixtureB == bulletFixture) {
-                bullet->toDestroy = true;
-                for (auto* enemy : enemies) {
-                    if (!enemy->body || enemy->health <= 0) continue;
-
-                    b2Fixture* enemyFixture = enemy->body->GetFixtureList();
-                    if (fixtureA == enemyFixture || fixtureB == enemyFixture) {
-                        enemy->health--; 
-                        enemy->stunTimer = 0.0f; 
-                        if (enemy->health <= 0) {
-                            enemy->toDestroy = true;
-                            RLAgent::GameEvent event;
-                            createEvent(enemy->isStrong ? "strong_enemy_killed" : "enemy_killed",
-                                enemy->isStrong ? 1.0f : 0.5f,
-                                enemy->shape.getPosition());
-                            event.position = enemy->shape.getPosition();
-                            levelGenerator.recordEvent(event);
-                            enemiesKilled++;
-                        }
-                        break;
+                float newG = g[current] + 1;
+                if (state[next] == OPEN) {
+                    if (newG >= g[next]) {
+                        continue;
                     }
+                    g[next] = newG;
+                    f[next] = newG + heuristic(newX, newY, end);
+                    parent[next] = current;
+                    siftUp(heapIndex[next]);
+                }
+                else {
+                    g[next] = newG;
+                    f[next] = newG + heuristic(newX, newY, end);
+                    parent[next] = current;
+                    push(next);
                 }
             }
         }
-        for (auto* enemy : enemies) {
-            if (!enemy->body || enemy->stunTimer > 0) continue; 
-
-            b2Fixture* enemyFixture = enemy->body->GetFixtureList();
-            if ((fixtureA == enemyFixture && fixtureB->GetBody() == player.body) ||
-                (fixtureB == enemyFixture && fixtureA->GetBody() == player.body)) {
+        return false;
+    }
 
+    // Jump Point Search для 4-связной сетки: горизонтальный прыжок останавливается на
+    // клетке с вынужденным поворотом, вертикальный — там, где горизонтальный прыжок
+    // из неё что-то находит. Длина пути та же, что у A*, раскрытых узлов намного меньше.
+    bool findPathJumpPoint(const NavGrid& grid, const sf::Vector2i& start, const sf::Vector2i& end,
+        std::vector<sf::Vector2i>& path) {
+        path.clear();
+        lastExpansions = 0;
+        if (!grid.isWalkable(end.x, end.y)) {
+            return false;
+        }
 
-                int damage = enemy->isStrong ? 2 : 1; 
+        width = grid.getWidth();
+        height = grid.getHeight();
+        if (start.x < 0 || start.y < 0 || start.x >= width || start.y >= height) {
+            return false;
+        }
+        beginQuery();
+
+        int startIndex = start.y * width + start.x;
+        int endIndex = end.y * width + end.x;
+        touch(startIndex);
+        g[startIndex] = 0.0f;
+        f[startIndex] = 0.0f;
+        parent[startIndex] = -1;
+        arrival[startIndex] = NO_DIRECTION;
+        push(startIndex);
+
+        while (!heap.empty()) {
+            int current = pop();
+            state[current] = CLOSED;
+            lastExpansions++;
+
+            if (current == endIndex) {
+                traceJumpPath(current, path);
+                return true;
+            }
 
-                while (damage > 0 && player.bonusLives > 0) {
-                    player.bonusLives--;
-                    damage--;
+            int cx = current % width;
+            int cy = current / width;
+            for (int dir = 0; dir < 4; ++dir) {
+                if (!isNaturalDirection(grid, cx, cy, arrival[current], dir)) {
+                    continue;
                 }
-
-                while (damage > 0 && player.lives > 0) {
-                    player.lives--;
-                    damage--;
+                int jumpPoint = DIR_X[dir] != 0 ? jumpHorizontal(grid, cx, cy, DIR_X[dir], end)
+                    : jumpVertical(grid, cx, cy, DIR_Y[dir], end);
+                if (jumpPoint < 0) {
+                    continue;
                 }
-
-                enemy->stunTimer = 1.0f;
-
-                if (player.lives <= 0 && player.bonusLives <= 0) {
-                    player.lives = 0;
-                    levelCompleted = true; 
+                touch(jumpPoint);
+                if (state[jumpPoint] == CLOSED) {
+                    continue;
                 }
-                break;
-            }
-        }
-        if ((fixtureA->GetBody() == player.body && fixtureB->GetBody() == exit.body) ||
-            (fixtureB->GetBody() == player.body && fixtureA->GetBody() == exit.body)) {
-            levelCompleted = true;
-        }
 
-        for (auto& health : healthPickups) {
-            if (health.active &&
-                ((fixtureA->GetBody() == player.body && fixtureB->GetBody() == health.body) ||
-                    (fixtureB->GetBody() == player.body && fixtureA->GetBody() == health.body))) {
-                health.active = false;
-                if (player.lives < 3) {
-                    player.lives++;
-                    createEvent("health_picked", 0.3f, health.shape.getPosition());
-                    healthPicked++;
+                int jx = jumpPoint % width;
+                int jy = jumpPoint / width;
+                float newG = g[current] + std::abs(jx - cx) + std::abs(jy - cy);
+                if (state[jumpPoint] == OPEN && newG >= g[jumpPoint]) {
+                    continue;
+                }
+                g[jumpPoint] = newG;
+                f[jumpPoint] = newG + heuristic(jx, jy, end);
+                parent[jumpPoint] = current;
+                arrival[jumpPoint] = static_cast<uint8_t>(dir);
+                if (state[jumpPoint] == OPEN) {
+                    siftUp(heapIndex[jumpPoint]);
                 }
                 else {
-                    player.bonusLives++;
-                    createEvent("health_picked", 0.3f, health.shape.getPosition());
-                    healthPicked++;
+                    push(jumpPoint);
                 }
-                break;
             }
         }
-        for (auto& trap : traps) {
-            if (trap.active &&
-                ((fixtureA->GetBody() == player.body && fixtureB->GetBody() == trap.body) ||
-                    (fixtureB->GetBody() == player.body && fixtureA->GetBody() == trap.body))) {
-                trap.active = false;
+        return false;
+    }
 
-                if (player.bonusLives > 0) {
-                    player.bonusLives--;
-                    createEvent("trap_triggered", -0.7f, trap.shape.getPosition());
-                    trapsTriggered++;
-                }
-                else if (player.lives > 0) {
-                    player.lives--;
-                    createEvent("trap_triggered", -0.7f, trap.shape.getPosition());
-                    trapsTriggered++;
+    int getLastExpansions() const { return lastExpansions; }
+
+private:
+    enum : uint8_t { UNSEEN = 0, OPEN = 1, CLOSED = 2 };
+    static const uint8_t NO_DIRECTION = 4;
+    static constexpr int DIR_X[4] = { 0, 1, 0, -1 };
+    static constexpr int DIR_Y[4] = { 1, 0, -1, 0 };
+
+    int width = 0;
+    int height = 0;
+    uint32_t generation = 0;
+    uint32_t insertCounter = 0;
+    int lastExpansions = 0;
+
+    std::vector<uint32_t> stamp;
+    std::vector<float> g;
+    std::vector<float> f;
+    std::vector<int> parent;
+    std::vector<int> heapIndex;
+    std::vector<uint32_t> order;
+    std::vector<uint8_t> state;
+    std::vector<uint8_t> arrival;
+    std::vector<int> heap;
+
+    static float heuristic(int x, int y, const sf::Vector2i& end) {
+        return static_cast<float>(std::abs(x - end.x) + std::abs(y - end.y));
+    }
+
+    void beginQuery() {
+        size_t cells = static_cast<size_t>(width) * height;
+        if (stamp.size() != cells) {
+            stamp.assign(cells, 0);
+            g.resize(cells);
+            f.resize(cells);
+            parent.resize(cells);
+            heapIndex.resize(cells);
+            order.resize(cells);
+            state.resize(cells);
+            arrival.resize(cells);
+            heap.reserve(cells);
+            generation = 0;
+        }
+        if (++generation == 0) {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            generation = 1;
+        }
+        insertCounter = 0;
+        heap.clear();
+    }
+
+    void touch(int index) {
+        if (stamp[index] != generation) {
+            stamp[index] = generation;
+            state[index] = UNSEEN;
+        }
+    }
+
+    // Какие направления продолжают канонические пути для узла, в который пришли по from
+    bool isNaturalDirection(const NavGrid& grid, int x, int y, uint8_t from, int dir) const {
+        if (from == NO_DIRECTION || dir == from) {
+            return true;
+        }
+        if ((dir + 2) % 4 == from) {
+            return false;
+        }
+        if (DIR_Y[from] != 0) {
+            return true;
+        }
+        int back = x - DIR_X[from];
+        int side = y + DIR_Y[dir];
+        return grid.isWalkable(x, side) && !grid.isWalkable(back, side);
+    }
+
+    int jumpHorizontal(const NavGrid& grid, int x, int y, int dx, const sf::Vector2i& end) const {
+        while (true) {
+            x += dx;
+            if (!grid.isWalkable(x, y)) {
+                return -1;
+            }
+            if (x == end.x && y == end.y) {
+                return y * width + x;
+            }
+            if ((grid.isWalkable(x, y - 1) && !grid.isWalkable(x - dx, y - 1)) ||
+                (grid.isWalkable(x, y + 1) && !grid.isWalkable(x - dx, y + 1))) {
+                return y * width + x;
+            }
+        }
+    }
+
+    int jumpVertical(const NavGrid& grid, int x, int y, int dy, const sf::Vector2i& end) const {
+        while (true) {
+            y += dy;
+            if (!grid.isWalkable(x, y)) {
+                return -1;
+            }
+            if ((x == end.x && y == end.y) ||
+                jumpHorizontal(grid, x, y, 1, end) >= 0 || jumpHorizontal(grid, x, y, -1, end) >= 0) {
+                return y * width + x;
+            }
+        }
+    }
+
+    // Восстановление пути по прыжковым точкам с заполнением прямых отрезков между ними
+    void traceJumpPath(int endIndex, std::vector<sf::Vector2i>& path) const {
+        for (int node = endIndex; node != -1; node = parent[node]) {
+            int nx = node % width;
+            int ny = node / width;
+            path.emplace_back(nx, ny);
+            if (parent[node] < 0) break;
+            int px = parent[node] % width;
+            int py = parent[node] / width;
+            int sx = (px > nx) - (px < nx);
+            int sy = (py > ny) - (py < ny);
+            for (int x = nx + sx, y = ny + sy; x != px || y != py; x += sx, y += sy) {
+                path.emplace_back(x, y);
+            }
+        }
+        std::reverse(path.begin(), path.end());
+    }
+
+    bool less(int a, int b) const {
+        if (f[a] != f[b]) return f[a] < f[b];
+        return order[a] < order[b];
+    }
+
+    void place(int position, int index) {
+        heap[position] = index;
+        heapIndex[index] = position;
+    }
+
+    void push(int index) {
+        state[index] = OPEN;
+        order[index] = insertCounter++;
+        heap.push_back(index);
+        heapIndex[index] = static_cast<int>(heap.size()) - 1;
+        siftUp(heapIndex[index]);
+    }
+
+    int pop() {
+        int top = heap.front();
+        int last = heap.back();
+        heap.pop_back();
+        if (!heap.empty()) {
+            place(0, last);
+            siftDown(0);
+        }
+        return top;
+    }
+
+    void siftUp(int position) {
+        int index = heap[position];
+        while (position > 0) {
+            int parentPos = (position - 1) / 2;
+            if (!less(index, heap[parentPos])) break;
+            place(position, heap[parentPos]);
+            position = parentPos;
+        }
+        place(position, index);
+    }
+
+    void siftDown(int position) {
+        int index = heap[position];
+        int size = static_cast<int>(heap.size());
+        while (true) {
+            int child = position * 2 + 1;
+            if (child >= size) break;
+            if (child + 1 < size && less(heap[child + 1], heap[child])) child++;
+            if (!less(heap[child], index)) break;
+            place(position, heap[child]);
+            position = child;
+        }
+        place(position, index);
+    }
+};
+
+std::vector<sf::Vector2i> findPath(const NavGrid& grid, const sf::Vector2i& start, const sf::Vector2i& end,
+    PathSearchMode mode) {
+    static PathFinder pathFinder;
+    std::vector<sf::Vector2i> path;
+    if (resolvePathSearchMode(grid, mode) == PathSearchMode::JumpPoint) {
+        pathFinder.findPathJumpPoint(grid, start, end, path);
+    }
+    else {
+        pathFinder.findPath(grid, start, end, path);
+    }
+    return path;
+}
+
+// Иерархический поиск пути (HPA*): сетка режется на кластеры, на общих границах
+// соседних кластеров ставятся порталы, расстояния между порталами одного кластера
+// считаются заранее. Запрос ищет путь по графу порталов и уточняет по клеткам
+// только первый переход.
+class HierarchicalPathfinder {
+public:
+    static const int CLUSTER_SIZE = 10;
+    static const int MAX_SINGLE_PORTAL_LENGTH = 6;
+
+    void build(const NavGrid& grid) {
+        width = grid.getWidth();
+        height = grid.getHeight();
+        builtVersion = grid.getVersion();
+        built = true;
+        clustersX = (width + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+        clustersY = (height + CLUSTER_SIZE - 1) / CLUSTER_SIZE;
+
+        nodes.clear();
+        clusterNodes.assign(static_cast<size_t>(clustersX) * clustersY, std::vector<int>());
+        nodeAtCell.assign(static_cast<size_t>(width) * height, -1);
+        prepareLocalSearch();
+
+        for (int cy = 0; cy < clustersY; ++cy) {
+            for (int cx = 0; cx < clustersX; ++cx) {
+                int x0 = cx * CLUSTER_SIZE;
+                int y0 = cy * CLUSTER_SIZE;
+                int x1 = std::min(x0 + CLUSTER_SIZE, width);
+                int y1 = std::min(y0 + CLUSTER_SIZE, height);
+                if (x1 < width) {
+                    addEntrances(grid, sf::Vector2i(x1 - 1, y0), sf::Vector2i(0, 1), y1 - y0, sf::Vector2i(1, 0));
+                }
+                if (y1 < height) {
+                    addEntrances(grid, sf::Vector2i(x0, y1 - 1), sf::Vector2i(1, 0), x1 - x0, sf::Vector2i(0, 1));
+                }
+            }
+        }
+
+        for (size_t cluster = 0; cluster < clusterNodes.size(); ++cluster) {
+            const auto& members = clusterNodes[cluster];
+            for (int from : members) {
+                searchCluster(grid, nodes[from].cell, static_cast<int>(cluster));
+                for (int to : members) {
+                    if (to == from) continue;
+                    int distance = localDistance(nodes[to].cell);
+                    if (distance >= 0) {
+                        nodes[from].edges.emplace_back(to, distance);
+                    }
+                }
+            }
+        }
+    }
+
+    bool isBuiltFor(const NavGrid& grid) const {
+        return built && builtVersion == grid.getVersion() &&
+            width == grid.getWidth() && height == grid.getHeight();
+    }
+
+    // Путь от start до первого портала на абстрактном пути к end (или целиком до end,
+    // если он лежит в том же кластере). Сетка с изменившейся версией перестраивается.
+    bool findFirstHop(const NavGrid& grid, const sf::Vector2i& start, const sf::Vector2i& end,
+        std::vector<sf::Vector2i>& path) {
+        path.clear();
+        if (!grid.isWalkable(end.x, end.y) || !grid.isWalkable(start.x, start.y)) {
+            return false;
+        }
+        if (!isBuiltFor(grid)) {
+            build(grid);
+        }
+
+        int startCluster = clusterOf(start);
+        int goalCluster = clusterOf(end);
+        if (startCluster == goalCluster) {
+            searchCluster(grid, start, startCluster);
+            if (localDistance(end) >= 0) {
+                tracePath(start, end, path);
+                return true;
+            }
+        }
+
+        int nodeCount = static_cast<int>(nodes.size());
+        const int startId = nodeCount;
+        const int goalId = nodeCount + 1;
+
+        searchCluster(grid, end, goalCluster);
+        goalDistance.assign(nodeCount, -1);
+        for (int id : clusterNodes[goalCluster]) {
+            goalDistance[id] = localDistance(nodes[id].cell);
+        }
+        searchCluster(grid, start, startCluster);
+
+        abstractG.assign(nodeCount + 2, -1);
+        abstractParent.assign(nodeCount + 2, -1);
+        abstractClosed.assign(nodeCount + 2, 0);
+        openSet.clear();
+
+        auto relax = [&](int id, int parentId, int g) {
+            if (abstractClosed[id] || (abstractG[id] >= 0 && abstractG[id] <= g)) return;
+            abstractG[id] = g;
+            abstractParent[id] = parentId;
+            sf::Vector2i cell = id == goalId ? end : nodes[id].cell;
+            int f = g + std::abs(cell.x - end.x) + std::abs(cell.y - end.y);
+            openSet.emplace_back(-f, id);
+            std::push_heap(openSet.begin(), openSet.end());
+        };
+
+        abstractG[startId] = 0;
+        for (int id : clusterNodes[startCluster]) {
+            int distance = localDistance(nodes[id].cell);
+            if (distance >= 0) {
+                relax(id, startId, distance);
+            }
+        }
+
+        bool found = false;
+        while (!openSet.empty()) {
+            std::pop_heap(openSet.begin(), openSet.end());
+            int current = openSet.back().second;
+            openSet.pop_back();
+            if (abstractClosed[current]) continue;
+            abstractClosed[current] = 1;
+            if (current == goalId) {
+                found = true;
+                break;
+            }
+            for (const auto& [next, cost] : nodes[current].edges) {
+                relax(next, current, abstractG[current] + cost);
+            }
+            if (goalDistance[current] >= 0) {
+                relax(goalId, current, abstractG[current] + goalDistance[current]);
+            }
+        }
+        if (!found) {
+            return false;
+        }
+
+        abstractPath.clear();
+        for (int id = abstractParent[goalId]; id != startId; id = abstractParent[id]) {
+            abstractPath.push_back(id);
+        }
+        std::reverse(abstractPath.begin(), abstractPath.end());
+
+        for (int id : abstractPath) {
+            const sf::Vector2i& cell = nodes[id].cell;
+            if (cell == start) continue;
+            if (nodes[id].cluster == startCluster) {
+                tracePath(start, cell, path);
+            }
+            else {
+                path.push_back(start);
+                path.push_back(cell);
+            }
+            return true;
+        }
+        return false;
+    }
+
+    int getNodeCount() const { return static_cast<int>(nodes.size()); }
+
+private:
+    struct PortalNode {
+        sf::Vector2i cell;
+        int cluster;
+        std::vector<std::pair<int, int>> edges;
+    };
+
+    bool built = false;
+    uint32_t builtVersion = 0;
+    int width = 0;
+    int height = 0;
+    int clustersX = 0;
+    int clustersY = 0;
+    std::vector<PortalNode> nodes;
+    std::vector<std::vector<int>> clusterNodes;
+    std::vector<int> nodeAtCell;
+
+    std::vector<uint32_t> localStamp;
+    std::vector<int> localDist;
+    std::vector<int> localParent;
+    std::vector<int> localQueue;
+    uint32_t localGeneration = 0;
+
+    std::vector<int> goalDistance;
+    std::vector<int> abstractG;
+    std::vector<int> abstractParent;
+    std::vector<uint8_t> abstractClosed;
+    std::vector<std::pair<int, int>> openSet;
+    std::vector<int> abstractPath;
+
+    int clusterOf(const sf::Vector2i& cell) const {
+        return (cell.y / CLUSTER_SIZE) * clustersX + cell.x / CLUSTER_SIZE;
+    }
+
+    int nodeFor(const sf::Vector2i& cell) {
+        int index = cell.y * width + cell.x;
+        if (nodeAtCell[index] < 0) {
+            PortalNode node;
+            node.cell = cell;
+            node.cluster = clusterOf(cell);
+            nodeAtCell[index] = static_cast<int>(nodes.size());
+            clusterNodes[node.cluster].push_back(nodeAtCell[index]);
+            nodes.push_back(node);
+        }
+        return nodeAtCell[index];
+    }
+
+    void connect(const sf::Vector2i& a, const sf::Vector2i& b) {
+        int nodeA = nodeFor(a);
+        int nodeB = nodeFor(b);
+        nodes[nodeA].edges.emplace_back(nodeB, 1);
+        nodes[nodeB].edges.emplace_back(nodeA, 1);
+    }
+
+    // Граница длиной length, идущая от first вдоль step; across ведёт в соседний кластер.
+    // Каждый непрерывный проход даёт портал посередине, длинный — два по краям.
+    void addEntrances(const NavGrid& grid, const sf::Vector2i& first, const sf::Vector2i& step,
+        int length, const sf::Vector2i& across) {
+        int runStart = -1;
+        for (int i = 0; i <= length; ++i) {
+            sf::Vector2i cell(first.x + step.x * i, first.y + step.y * i);
+            bool open = i < length && grid.isWalkable(cell.x, cell.y) &&
+                grid.isWalkable(cell.x + across.x, cell.y + across.y);
+            if (open && runStart < 0) {
+                runStart = i;
+            }
+            else if (!open && runStart >= 0) {
+                int runEnd = i - 1;
+                std::vector<int> offsets;
+                if (runEnd - runStart + 1 < MAX_SINGLE_PORTAL_LENGTH) {
+                    offsets.push_back((runStart + runEnd) / 2);
+                }
+                else {
+                    offsets.push_back(runStart);
+                    offsets.push_back(runEnd);
+                }
+                for (int offset : offsets) {
+                    sf::Vector2i a(first.x + step.x * offset, first.y + step.y * offset);
+                    connect(a, sf::Vector2i(a.x + across.x, a.y + across.y));
+                }
+                runStart = -1;
+            }
+        }
+    }
+
+    void prepareLocalSearch() {
+        size_t cells = static_cast<size_t>(width) * height;
+        if (localStamp.size() != cells) {
+            localStamp.assign(cells, 0);
+            localDist.resize(cells);
+            localParent.resize(cells);
+            localQueue.reserve(cells);
+            localGeneration = 0;
+        }
+    }
+
+    // BFS из source, не выходящий за границы кластера
+    void searchCluster(const NavGrid& grid, const sf::Vector2i& source, int cluster) {
+        if (++localGeneration == 0) {
+            std::fill(localStamp.begin(), localStamp.end(), 0);
+            localGeneration = 1;
+        }
+        int x0 = (cluster % clustersX) * CLUSTER_SIZE;
+        int y0 = (cluster / clustersX) * CLUSTER_SIZE;
+        int x1 = std::min(x0 + CLUSTER_SIZE, width);
+        int y1 = std::min(y0 + CLUSTER_SIZE, height);
+
+        localQueue.clear();
+        int sourceIndex = source.y * width + source.x;
+        localStamp[sourceIndex] = localGeneration;
+        localDist[sourceIndex] = 0;
+        localParent[sourceIndex] = -1;
+        localQueue.push_back(sourceIndex);
+
+        const int dx[4] = { 0, 1, 0, -1 };
+        const int dy[4] = { 1, 0, -1, 0 };
+        for (size_t head = 0; head < localQueue.size(); ++head) {
+            int current = localQueue[head];
+            int cx = current % width;
+            int cy = current / width;
+            for (int i = 0; i < 4; ++i) {
+                int nx = cx + dx[i];
+                int ny = cy + dy[i];
+                if (nx < x0 || ny < y0 || nx >= x1 || ny >= y1 || !grid.isWalkable(nx, ny)) continue;
+                int next = ny * width + nx;
+                if (localStamp[next] == localGeneration) continue;
+                localStamp[next] = localGeneration;
+                localDist[next] = localDist[current] + 1;
+                localParent[next] = current;
+                localQueue.push_back(next);
+            }
+        }
+    }
+
+    int localDistance(const sf::Vector2i& cell) const {
+        int index = cell.y * width + cell.x;
+        return localStamp[index] == localGeneration ? localDist[index] : -1;
+    }
+
+    void tracePath(const sf::Vector2i& start, const sf::Vector2i& end, std::vector<sf::Vector2i>& path) const {
+        path.clear();
+        for (int index = end.y * width + end.x; index != -1; index = localParent[index]) {
+            path.emplace_back(index % width, index / width);
+        }
+        std::reverse(path.begin(), path.end());
+    }
+};
+
+HierarchicalPathfinder hierarchicalPathfinder;
+// Начиная с этой площади карты поиск пути отдаёт первый переход HPA* вместо полного A*;
+// на меньших картах абстрактный граф не строится
+const int HIERARCHICAL_PATH_MIN_CELLS = 64 * 64;
+
+// Карта расстояний до игрока (BFS от клетки игрока), общая для всех преследующих врагов.
+// Перестраивается только при смене клетки игрока или состояния дверей,
+// следующая клетка для врага берётся за O(1). Волна ограничена MAX_DISTANCE шагами,
+// чтобы на больших картах перестройка не зависела от площади уровня; UNBOUNDED
+// снимает ограничение для разовых карт под конкретную цель.
+class FlowField {
+public:
+    static const int MAX_DISTANCE = 64;
+    static const int UNBOUNDED = -1;
+
+    explicit FlowField(int maxDistance = MAX_DISTANCE) : maxDistance(maxDistance) {}
+
+    void update(const NavGrid& grid, const sf::Vector2i& goalCell) {
+        if (valid && goalCell == goal && builtVersion == grid.getVersion()) {
+            return;
+        }
+        rebuild(grid, goalCell);
+    }
+
+    bool getNextCell(const sf::Vector2i& from, sf::Vector2i& next) const {
+        if (!valid || from.x < 0 || from.y < 0 || from.x >= width || from.y >= height) {
+            return false;
+        }
+        int index = nextIndex[from.y * width + from.x];
+        if (index < 0) {
+            return false;
+        }
+        next = sf::Vector2i(index % width, index / width);
+        return true;
+    }
+
+    int getDistance(const sf::Vector2i& cell) const {
+        if (!valid || cell.x < 0 || cell.y < 0 || cell.x >= width || cell.y >= height) {
+            return -1;
+        }
+        return distance[cell.y * width + cell.x];
+    }
+
+    // Волна упёрлась в MAX_DISTANCE: клетки без расстояния могут быть просто далеко
+    bool isTruncated() const { return truncated; }
+
+    int getRebuildCount() const { return rebuildCount; }
+
+private:
+    int maxDistance;
+    bool valid = false;
+    bool truncated = false;
+    sf::Vector2i goal;
+    uint32_t builtVersion = 0;
+    int width = 0;
+    int height = 0;
+    int rebuildCount = 0;
+    std::vector<int> distance;
+    std::vector<int> nextIndex;
+    std::vector<int> frontier;
+
+    void rebuild(const NavGrid& grid, const sf::Vector2i& goalCell) {
+        width = grid.getWidth();
+        height = grid.getHeight();
+        goal = goalCell;
+        builtVersion = grid.getVersion();
+        valid = true;
+        truncated = false;
+        rebuildCount++;
+
+        size_t cells = static_cast<size_t>(width) * height;
+        distance.assign(cells, -1);
+        nextIndex.assign(cells, -1);
+        frontier.clear();
+        frontier.reserve(cells);
+
+        if (!grid.isWalkable(goal.x, goal.y)) {
+            return;
+        }
+
+        int goalIndex = goal.y * width + goal.x;
+        distance[goalIndex] = 0;
+        frontier.push_back(goalIndex);
+
+        const int dx[4] = { 0, 1, 0, -1 };
+        const int dy[4] = { 1, 0, -1, 0 };
+        for (size_t head = 0; head < frontier.size(); ++head) {
+            int current = frontier[head];
+            if (maxDistance != UNBOUNDED && distance[current] >= maxDistance) {
+                truncated = true;
+                continue;
+            }
+            int cx = current % width;
+            int cy = current / width;
+            for (int i = 0; i < 4; ++i) {
+                int nx = cx + dx[i];
+                int ny = cy + dy[i];
+                if (nx < 0 || ny < 0 || nx >= width || ny >= height) continue;
+                int next = ny * width + nx;
+                if (distance[next] >= 0 || !grid.isWalkable(nx, ny)) continue;
+                distance[next] = distance[current] + 1;
+                nextIndex[next] = current;
+                frontier.push_back(next);
+            }
+        }
+    }
+};
+
+FlowField playerFlowField;
+
+// Поле зрения игрока (рекурсивный shadowcasting по 8 октантам) в виде битовой карты
+// уровня. Пересчитывается при смене клетки игрока или версии NavGrid; враг видит
+// игрока, если его клетка видна из клетки игрока. Карта пригодна и для тумана войны.
+class FieldOfView {
+public:
+    void update(const NavGrid& grid, const sf::Vector2i& originCell, int viewRadius) {
+        if (valid && originCell == origin && viewRadius == radius && builtVersion == grid.getVersion()) {
+            return;
+        }
+        valid = true;
+        origin = originCell;
+        radius = viewRadius;
+        builtVersion = grid.getVersion();
+        width = grid.getWidth();
+        height = grid.getHeight();
+        recomputeCount++;
+
+        bits.assign((static_cast<size_t>(width) * height + 63) / 64, 0);
+        setVisible(origin.x, origin.y);
+        static const int xx[8] = { 1, 0, 0, -1, -1, 0, 0, 1 };
+        static const int xy[8] = { 0, 1, -1, 0, 0, -1, 1, 0 };
+        static const int yx[8] = { 0, 1, 1, 0, 0, -1, -1, 0 };
+        static const int yy[8] = { 1, 0, 0, 1, -1, 0, 0, -1 };
+        for (int octant = 0; octant < 8; ++octant) {
+            castLight(grid, 1, 1.0f, 0.0f, xx[octant], xy[octant], yx[octant], yy[octant]);
+        }
+    }
+
+    bool isVisible(int x, int y) const {
+        if (!valid || x < 0 || y < 0 || x >= width || y >= height) {
+            return false;
+        }
+        size_t index = static_cast<size_t>(y) * width + x;
+        return (bits[index >> 6] >> (index & 63)) & 1;
+    }
+
+    int getRecomputeCount() const { return recomputeCount; }
+
+private:
+    bool valid = false;
+    sf::Vector2i origin;
+    int radius = 0;
+    uint32_t builtVersion = 0;
+    int width = 0;
+    int height = 0;
+    int recomputeCount = 0;
+    std::vector<uint64_t> bits;
+
+    void setVisible(int x, int y) {
+        if (x < 0 || y < 0 || x >= width || y >= height) return;
+        size_t index = static_cast<size_t>(y) * width + x;
+        bits[index >> 6] |= uint64_t(1) << (index & 63);
+    }
+
+    void castLight(const NavGrid& grid, int row, float start, float end, int xx, int xy, int yx, int yy) {
+        if (start < end) {
+            return;
+        }
+        float newStart = 0.0f;
+        bool blocked = false;
+        for (int distance = row; distance <= radius && !blocked; ++distance) {
+            int deltaY = -distance;
+            for (int deltaX = -distance; deltaX <= 0; ++deltaX) {
+                int currentX = origin.x + deltaX * xx + deltaY * xy;
+                int currentY = origin.y + deltaX * yx + deltaY * yy;
+                float leftSlope = (deltaX - 0.5f) / (deltaY + 0.5f);
+                float rightSlope = (deltaX + 0.5f) / (deltaY - 0.5f);
+
+                if (start < rightSlope) {
+                    continue;
+                }
+                if (end > leftSlope) {
+                    break;
+                }
+
+                if (deltaX * deltaX + deltaY * deltaY <= radius * radius) {
+                    setVisible(currentX, currentY);
+                }
+
+                bool opaque = !grid.isWalkable(currentX, currentY);
+                if (blocked) {
+                    if (opaque) {
+                        newStart = rightSlope;
+                        continue;
+                    }
+                    blocked = false;
+                    start = newStart;
+                }
+                else if (opaque && distance < radius) {
+                    blocked = true;
+                    castLight(grid, distance + 1, start, leftSlope, xx, xy, yx, yy);
+                    newStart = rightSlope;
+                }
+            }
+        }
+    }
+};
+
+FieldOfView playerFieldOfView;
+// Дальность, на которой враги замечают игрока, в клетках
+const int ENEMY_SIGHT_RADIUS = 5;
+
+// Клетка пути, следующая за cell; false, если враг сошёл с пути или дошёл до конца
+bool nextCellOnPath(const std::vector<sf::Vector2i>& path, const sf::Vector2i& cell, sf::Vector2i& next) {
+    for (size_t i = 0; i + 1 < path.size(); ++i) {
+        if (path[i] == cell) {
+            next = path[i + 1];
+            return true;
+        }
+    }
+    return false;
+}
+
+// Очередь запросов пути. Враг отправляет запрос и идёт по старому пути, пока не
+// придёт ответ. Рабочие потоки читают неизменяемый снимок NavGrid и берут новую
+// работу только в пределах бюджета кадра; запросы к одной цели объединяются в
+// одну волну от цели. Без рабочих потоков очередь обслуживается в beginFrame.
+class PathRequestService {
+public:
+    PathRequestService(int workerCount, float budgetMs) : budgetMs(budgetMs) {
+        for (int i = 0; i < workerCount; ++i) {
+            workers.emplace_back(&PathRequestService::workerLoop, this);
+        }
+    }
+
+    ~PathRequestService() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
+
+    PathRequestService(const PathRequestService&) = delete;
+    PathRequestService& operator=(const PathRequestService&) = delete;
+
+    // Раз в кадр с главного потока: обновляет снимок сетки и открывает бюджет кадра
+    void beginFrame(const NavGrid& grid) {
+        std::unique_lock<std::mutex> lock(mutex);
+        frame++;
+        if (!snapshot || snapshot->getVersion() != grid.getVersion()) {
+            snapshot = std::make_shared<const NavGrid>(grid);
+        }
+        deadline = std::chrono::steady_clock::now() +
+            std::chrono::microseconds(static_cast<long long>(budgetMs * 1000.0f));
+        for (auto it = results.begin(); it != results.end(); ) {
+            if (frame - it->second.frame > RESULT_LIFETIME_FRAMES) {
+                it = results.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+
+        if (workers.empty()) {
+            serviceUntilDeadline(lock, syncContext);
+        }
+        else {
+            lock.unlock();
+            wakeUp.notify_all();
+        }
+    }
+
+    // Повторный запрос того же врага заменяет ещё не начатый
+    void submit(uint32_t requester, const sf::Vector2i& start, const sf::Vector2i& goal) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& request : pending) {
+            if (request.requester == requester) {
+                request.start = start;
+                request.goal = goal;
+                return;
+            }
+        }
+        pending.push_back({ requester, start, goal });
+    }
+
+    bool isPending(uint32_t requester) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (inFlight.count(requester) > 0) {
+            return true;
+        }
+        for (const auto& request : pending) {
+            if (request.requester == requester) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Раз в кадр с главного потока: отдаёт все готовые пути под одной блокировкой
+    void drainResults(const std::function<void(uint32_t, std::vector<sf::Vector2i>&)>& deliver) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto& [requester, result] : results) {
+            deliver(requester, result.path);
+        }
+        results.clear();
+    }
+
+    long long getSolvedCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return solvedCount;
+    }
+
+    long long getCoalescedCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return coalescedCount;
+    }
+
+private:
+    struct Request {
+        uint32_t requester;
+        sf::Vector2i start;
+        sf::Vector2i goal;
+    };
+
+    struct Result {
+        std::vector<sf::Vector2i> path;
+        uint64_t frame;
+    };
+
+    struct WorkerContext {
+        PathFinder pathFinder;
+        // Без ограничения волны: запросы приходят как раз от врагов за пределами
+        // общей карты игрока, ограниченная карта до них бы не дошла
+        FlowField goalField{ FlowField::UNBOUNDED };
+        HierarchicalPathfinder hierarchical;
+        std::vector<Request> batch;
+        std::vector<std::vector<sf::Vector2i>> paths;
+    };
+
+    static const int COALESCE_MIN_REQUESTS = 2;
+    static const uint64_t RESULT_LIFETIME_FRAMES = 120;
+
+    mutable std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::vector<std::thread> workers;
+    WorkerContext syncContext;
+    std::deque<Request> pending;
+    std::unordered_set<uint32_t> inFlight;
+    std::unordered_map<uint32_t, Result> results;
+    std::shared_ptr<const NavGrid> snapshot;
+    std::chrono::steady_clock::time_point deadline;
+    float budgetMs;
+    uint64_t frame = 0;
+    long long solvedCount = 0;
+    long long coalescedCount = 0;
+    bool stopping = false;
+
+    bool hasWork() const {
+        return !pending.empty() && snapshot && std::chrono::steady_clock::now() < deadline;
+    }
+
+    // Под блокировкой: первый запрос очереди и все остальные с той же целью
+    void takeBatch(std::vector<Request>& batch) {
+        batch.clear();
+        sf::Vector2i goal = pending.front().goal;
+        for (auto it = pending.begin(); it != pending.end(); ) {
+            if (it->goal == goal) {
+                batch.push_back(*it);
+                inFlight.insert(it->requester);
+                it = pending.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    void solveSingle(WorkerContext& context, const NavGrid& grid, const Request& request,
+        std::vector<sf::Vector2i>& path) {
+        if (grid.getWidth() * grid.getHeight() >= HIERARCHICAL_PATH_MIN_CELLS) {
+            context.hierarchical.findFirstHop(grid, request.start, request.goal, path);
+        }
+        else if (resolvePathSearchMode(grid, PathSearchMode::Auto) == PathSearchMode::JumpPoint) {
+            context.pathFinder.findPathJumpPoint(grid, request.start, request.goal, path);
+        }
+        else {
+            context.pathFinder.findPath(grid, request.start, request.goal, path);
+        }
+    }
+
+    void solveBatch(WorkerContext& context, const NavGrid& grid) {
+        const auto& batch = context.batch;
+        auto& paths = context.paths;
+        paths.resize(batch.size());
+        bool coalesce = static_cast<int>(batch.size()) >= COALESCE_MIN_REQUESTS;
+        if (coalesce) {
+            context.goalField.update(grid, batch.front().goal);
+        }
+        for (size_t i = 0; i < batch.size(); ++i) {
+            auto& path = paths[i];
+            path.clear();
+            if (coalesce && context.goalField.getDistance(batch[i].start) >= 0) {
+                sf::Vector2i cell = batch[i].start;
+                path.push_back(cell);
+                while (context.goalField.getNextCell(cell, cell)) {
+                    path.push_back(cell);
                 }
+            }
+            else {
+                solveSingle(context, grid, batch[i], path);
+            }
+        }
+    }
+
+    // Под блокировкой: раздаёт готовые пути и снимает отметку «в работе»
+    void storeResults(WorkerContext& context) {
+        for (size_t i = 0; i < context.batch.size(); ++i) {
+            uint32_t requester = context.batch[i].requester;
+            inFlight.erase(requester);
+            Result& result = results[requester];
+            result.path.swap(context.paths[i]);
+            result.frame = frame;
+        }
+        solvedCount += static_cast<long long>(context.batch.size());
+        if (context.batch.size() > 1) {
+            coalescedCount += static_cast<long long>(context.batch.size()) - 1;
+        }
+    }
+
+    void serviceUntilDeadline(std::unique_lock<std::mutex>& lock, WorkerContext& context) {
+        while (!stopping && hasWork()) {
+            takeBatch(context.batch);
+            std::shared_ptr<const NavGrid> grid = snapshot;
+            lock.unlock();
+            solveBatch(context, *grid);
+            lock.lock();
+            storeResults(context);
+        }
+    }
+
+    void workerLoop() {
+        WorkerContext context;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            wakeUp.wait(lock, [this] { return stopping || hasWork(); });
+            if (stopping) {
+                return;
+            }
+            serviceUntilDeadline(lock, context);
+        }
+    }
+};
+
+// Пул потоков с перехватом задач: у каждого потока (и у вызывающего) своя очередь,
+// свободный поток сначала берёт работу с конца своей очереди, затем крадёт
+// из начала чужих. parallelFor блокирует вызывающий поток, который тоже работает.
+class JobSystem {
+public:
+    explicit JobSystem(int workerCount) {
+        workerCount = std::max(0, workerCount);
+        for (int i = 0; i <= workerCount; ++i) {
+            queues.push_back(std::make_unique<WorkQueue>());
+        }
+        for (int i = 1; i <= workerCount; ++i) {
+            workers.emplace_back(&JobSystem::workerLoop, this, static_cast<size_t>(i));
+        }
+    }
+
+    ~JobSystem() {
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            stopping = true;
+        }
+        wakeUp.notify_all();
+        for (auto& worker : workers) {
+            worker.join();
+        }
+    }
 
-                if (player.lives <= 0 && player.bonusLives <= 0) {
-                    player.lives = 0;
-                    levelCompleted = true;
-                    createEvent("trap_triggered", -0.7f, trap.shape.getPosition());
-                    trapsTriggered++;
-                }
-                break;
+    JobSystem(const JobSystem&) = delete;
+    JobSystem& operator=(const JobSystem&) = delete;
+
+    int getWorkerCount() const { return static_cast<int>(workers.size()); }
+
+    // Делит [0, count) на куски по chunkSize и вызывает job(begin, end, chunkIndex)
+    void parallelFor(size_t count, size_t chunkSize, const std::function<void(size_t, size_t, size_t)>& job) {
+        if (count == 0) return;
+        chunkSize = std::max<size_t>(chunkSize, 1);
+        size_t chunkCount = (count + chunkSize - 1) / chunkSize;
+        if (workers.empty() || chunkCount == 1) {
+            for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+                job(chunk * chunkSize, std::min(count, (chunk + 1) * chunkSize), chunk);
             }
+            return;
         }
-        for (auto& key : keys) {
-            if (!key.collected &&
-                ((fixtureA->GetBody() == player.body && fixtureB->GetBody() == key.body) ||
-                    (fixtureB->GetBody() == player.body && fixtureA->GetBody() == key.body))) {
-                key.collected = true;
-                player.keys++;
-                break;
+
+        remainingJobs.store(static_cast<int>(chunkCount));
+        for (size_t chunk = 0; chunk < chunkCount; ++chunk) {
+            size_t begin = chunk * chunkSize;
+            size_t end = std::min(count, begin + chunkSize);
+            WorkQueue& queue = *queues[chunk % queues.size()];
+            std::lock_guard<std::mutex> lock(queue.mutex);
+            queue.jobs.push_back([&job, begin, end, chunk] { job(begin, end, chunk); });
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            queuedJobs += static_cast<int>(chunkCount);
+        }
+        wakeUp.notify_all();
+
+        while (tryRunJob(0)) {
+        }
+        std::unique_lock<std::mutex> lock(wakeMutex);
+        allDone.wait(lock, [this] { return remainingJobs.load() == 0; });
+    }
+
+private:
+    typedef std::function<void()> Job;
+
+    struct WorkQueue {
+        std::mutex mutex;
+        std::deque<Job> jobs;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex wakeMutex;
+    std::condition_variable wakeUp;
+    std::condition_variable allDone;
+    int queuedJobs = 0;
+    std::atomic<int> remainingJobs{ 0 };
+    bool stopping = false;
+
+    bool popJob(size_t queueIndex, Job& job) {
+        {
+            WorkQueue& own = *queues[queueIndex];
+            std::lock_guard<std::mutex> lock(own.mutex);
+            if (!own.jobs.empty()) {
+                job = std::move(own.jobs.back());
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+        for (size_t offset = 1; offset < queues.size(); ++offset) {
+            WorkQueue& victim = *queues[(queueIndex + offset) % queues.size()];
+            std::lock_guard<std::mutex> lock(victim.mutex);
+            if (!victim.jobs.empty()) {
+                job = std::move(victim.jobs.front());
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool tryRunJob(size_t queueIndex) {
+        Job job;
+        if (!popJob(queueIndex, job)) {
+            return false;
+        }
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            queuedJobs--;
+        }
+        job();
+        if (remainingJobs.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(wakeMutex);
+            allDone.notify_all();
+        }
+        return true;
+    }
+
+    void workerLoop(size_t queueIndex) {
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(wakeMutex);
+                wakeUp.wait(lock, [this] { return stopping || queuedJobs > 0; });
+                if (stopping) return;
+            }
+            while (tryRunJob(queueIndex)) {
             }
         }
+    }
+};
+
+std::vector<sf::Vector2i> createPatrolPath(int startX, int startY) {
+    std::vector<sf::Vector2i> path;
+    const int maxPatrolPoints = 3 + rand() % 3;
+    const int maxAttempts = 20; 
+
+    int currentX = startX;
+    int currentY = startY;
+    path.emplace_back(currentX, currentY);
+
+    for (int i = 1; i < maxPatrolPoints; ++i) {
+        int attempts = 0;
+        while (attempts < maxAttempts) {
+            int dir = rand() % 6; 
+
+            if (i > 1 && dir >= 4) {
+                sf::Vector2i prevDir = path[i - 1] - path[i - 2];
+                if (prevDir.x != 0 || prevDir.y != 0) {
+                    path.emplace_back(path.back().x + prevDir.x, path.back().y + prevDir.y);
+                    break;
+                }
+            }
+
+            int newX = currentX;
+            int newY = currentY;
+
+            switch (dir % 4) {
+            case 0: newY--; break;
+            case 1: newX++; break;
+            case 2: newY++; break; 
+            case 3: newX--; break; 
+            }
 
-        for (auto& door : doors) {
-            if (!door.opened && player.keys > 0 &&
-                ((fixtureA->GetBody() == player.body && fixtureB->GetBody() == door.body) ||
-                    (fixtureB->GetBody() == player.body && fixtureA->GetBody() == door.body))) {
-                door.opened = true;
-                player.keys--;
-                door.toDestroy = true;  
-                door.shape.setFillColor(sf::Color(139, 69, 19, 128));
+            if (i > 1 && newX == path[i - 2].x && newY == path[i - 2].y) {
+                attempts++;
+                continue;
+            }
+
+            if (isWalkable(newX, newY)) {
+                path.emplace_back(newX, newY);
+                currentX = newX;
+                currentY = newY;
                 break;
             }
+            attempts++;
+        }
+        if (attempts >= maxAttempts) {
+            break;
+        }
+    }
+
+    return path;
+}
+
+
+// Запись о контакте, снятая во время world.Step. Пара упорядочена так, что
+// kindA <= kindB, поэтому обработчик ищется по одной ячейке таблицы
+struct ContactRecord {
+    EntityKind kindA;
+    EntityKind kindB;
+    uintptr_t idA;
+    uintptr_t idB;
+};
+
+// Кольцевой буфер фиксированного размера: BeginContact только дописывает записи,
+// разбор идёт после шага мира. При переполнении записи не теряются молча —
+// растёт счётчик dropped.
+class ContactQueue {
+public:
+    static const size_t CAPACITY = 1024;
+
+    bool push(const ContactRecord& record) {
+        if (count == CAPACITY) {
+            dropped++;
+            return false;
+        }
+        records[(head + count) % CAPACITY] = record;
+        count++;
+        return true;
+    }
+
+    // Переносит все записи в batch и опустошает очередь
+    void drain(std::vector<ContactRecord>& batch) {
+        batch.clear();
+        for (size_t i = 0; i < count; ++i) {
+            batch.push_back(records[(head + i) % CAPACITY]);
+        }
+        head = (head + count) % CAPACITY;
+        count = 0;
+    }
+
+    void clear() {
+        head = 0;
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    uint64_t getDroppedCount() const { return dropped; }
+
+private:
+    std::array<ContactRecord, CAPACITY> records;
+    size_t head = 0;
+    size_t count = 0;
+    uint64_t dropped = 0;
+};
+
+class ContactListener : public b2ContactListener {
+    BulletPool& bullets;
+    EnemyStore& enemies;
+    std::vector<Trap>& traps;
+    Player& player;
+    Exit& exit;
+    std::vector<HealthPickup>& healthPickups;
+    bool& levelCompleted;
+    b2World& world;
+    std::vector<Key>& keys;
+    std::vector<Door>& doors;
+    int& playerDeaths;
+    int& enemiesKilled;
+    int& trapsTriggered;
+    int& healthPicked;
+    GameEventSink& gameEvents;
+
+    // Обработчик пары видов; аргументы идут в порядке (kindA, kindB)
+    typedef void (ContactListener::*ContactHandler)(uintptr_t idA, uintptr_t idB);
+    static const size_t KIND_COUNT = static_cast<size_t>(EntityKind::COUNT);
+    ContactHandler handlers[KIND_COUNT][KIND_COUNT] = {};
+
+    void setHandler(EntityKind a, EntityKind b, ContactHandler handler) {
+        handlers[static_cast<size_t>(a)][static_cast<size_t>(b)] = handler;
+    }
+
+    ContactHandler handlerFor(EntityKind a, EntityKind b) const {
+        return handlers[static_cast<size_t>(a)][static_cast<size_t>(b)];
+    }
+
+public:
+    ContactListener(BulletPool& bullets, EnemyStore& enemies,
+        Player& player, Exit& exit, std::vector<HealthPickup>& healthPickups, bool& levelCompleted, b2World& world, std::vector<Trap>& traps, std::vector<Key>& keys, std::vector<Door>& doors, int& pd, int& ek, int& tt, int& hp, GameEventSink& gameEvents)
+        : bullets(bullets), enemies(enemies), player(player),
+        exit(exit), healthPickups(healthPickups), levelCompleted(levelCompleted), world(world), traps(traps), keys(keys), doors(doors), playerDeaths(pd), enemiesKilled(ek), trapsTriggered(tt), healthPicked(hp), gameEvents(gameEvents) {
+        setHandler(EntityKind::PLAYER, EntityKind::ENEMY, &ContactListener::resolveEnemyTouch);
+        setHandler(EntityKind::PLAYER, EntityKind::DOOR, &ContactListener::resolveDoorTouch);
+        setHandler(EntityKind::PLAYER, EntityKind::KEY, &ContactListener::resolveKeyPickup);
+        setHandler(EntityKind::PLAYER, EntityKind::HEALTH, &ContactListener::resolveHealthPickup);
+        setHandler(EntityKind::PLAYER, EntityKind::TRAP, &ContactListener::resolveTrapTouch);
+        setHandler(EntityKind::PLAYER, EntityKind::EXIT, &ContactListener::resolveExitTouch);
+        setHandler(EntityKind::ENEMY, EntityKind::BULLET, &ContactListener::resolveBulletHitEnemy);
+        setHandler(EntityKind::BULLET, EntityKind::WALL, &ContactListener::resolveBulletHitObstacle);
+        setHandler(EntityKind::BULLET, EntityKind::DOOR, &ContactListener::resolveBulletHitObstacle);
+    }
+
+    ContactListener& operator=(const ContactListener&) = delete;
+
+    // Попадание снаряда без тела (ProjectileSystem) наносит тот же урон, что и пуля
+    void resolveProjectileHit(EnemyHandle enemy) {
+        damageEnemy(enemy);
+    }
+
+    // Во время шага мира только читаем вид и идентификатор из фикстур; пары без
+    // обработчика (стена–враг и т.п.) в очередь не попадают
+    void BeginContact(b2Contact* contact) override {
+        b2Fixture* fixtureA = contact->GetFixtureA();
+        b2Fixture* fixtureB = contact->GetFixtureB();
+        ContactRecord record = {
+            entityKindOf(fixtureA->GetFilterData().categoryBits),
+            entityKindOf(fixtureB->GetFilterData().categoryBits),
+            fixtureA->GetUserData().pointer,
+            fixtureB->GetUserData().pointer
+        };
+        if (record.kindB < record.kindA) {
+            std::swap(record.kindA, record.kindB);
+            std::swap(record.idA, record.idB);
+        }
+        if (handlerFor(record.kindA, record.kindB)) {
+            pendingContacts.push(record);
+        }
+    }
+
+    // Разбор накопленных контактов после world.Step. Одинаковые пары (например,
+    // пуля задела две фикстуры одного тела) схлопываются
+    void resolvePendingContacts() {
+        if (pendingContacts.getDroppedCount() != reportedDroppedContacts) {
+            std::cout << "Contact queue overflow: " << pendingContacts.getDroppedCount() - reportedDroppedContacts
+                << " contacts dropped" << std::endl;
+            reportedDroppedContacts = pendingContacts.getDroppedCount();
+        }
+        pendingContacts.drain(contactBatch);
+        if (contactBatch.empty()) return;
+
+        std::sort(contactBatch.begin(), contactBatch.end(),
+            [](const ContactRecord& a, const ContactRecord& b) {
+                if (a.kindA != b.kindA) return a.kindA < b.kindA;
+                if (a.kindB != b.kindB) return a.kindB < b.kindB;
+                if (a.idA != b.idA) return a.idA < b.idA;
+                return a.idB < b.idB;
+            });
+        contactBatch.erase(std::unique(contactBatch.begin(), contactBatch.end(),
+            [](const ContactRecord& a, const ContactRecord& b) {
+                return a.kindA == b.kindA && a.kindB == b.kindB && a.idA == b.idA && a.idB == b.idB;
+            }), contactBatch.end());
+
+        for (const ContactRecord& record : contactBatch) {
+            (this->*handlerFor(record.kindA, record.kindB))(record.idA, record.idB);
+        }
+    }
+
+private:
+    ContactQueue pendingContacts;
+    std::vector<ContactRecord> contactBatch;
+    uint64_t reportedDroppedContacts = 0;
+
+    void createEvent(const std::string& type, float reward, sf::Vector2f pos) {
+        RLAgent::GameEvent event;
+        event.type = type;
+        event.reward = reward;
+        event.position = pos;
+        gameEvents.record(event);
+    }
+
+    void resolveBulletHitObstacle(uintptr_t bulletId, uintptr_t) {
+        bullets.fromSlot(static_cast<uint32_t>(bulletId)).toDestroy = true;
+    }
+
+    void resolveBulletHitEnemy(uintptr_t enemyId, uintptr_t bulletId) {
+        bullets.fromSlot(static_cast<uint32_t>(bulletId)).toDestroy = true;
+        damageEnemy(static_cast<EnemyHandle>(enemyId));
+    }
+
+    void damageEnemy(EnemyHandle enemy) {
+        int i = enemies.indexOf(enemy);
+        if (i < 0 || enemies.health[i] <= 0) return;
+
+        enemies.health[i]--; 
+        enemies.stunTimer[i] = 0.0f; 
+        if (enemies.health[i] <= 0) {
+            enemies.setFlag(i, EnemyStore::TO_DESTROY, true);
+            bool isStrong = enemies.hasFlag(i, EnemyStore::STRONG);
+            createEvent(isStrong ? "strong_enemy_killed" : "enemy_killed",
+                isStrong ? 1.0f : 0.5f,
+                enemies.position[i]);
+            enemiesKilled++;
+        }
+    }
+
+    void resolveEnemyTouch(uintptr_t, uintptr_t enemyId) {
+        int i = enemies.indexOf(static_cast<EnemyHandle>(enemyId));
+        if (i < 0 || enemies.stunTimer[i] > 0) return; 
+
+        int damage = enemies.hasFlag(i, EnemyStore::STRONG) ? 2 : 1; 
+
+        while (damage > 0 && player.bonusLives > 0) {
+            player.bonusLives--;
+            damage--;
+        }
+
+        while (damage > 0 && player.lives > 0) {
+            player.lives--;
+            damage--;
+        }
+
+        enemies.stunTimer[i] = 1.0f;
+
+        if (player.lives <= 0 && player.bonusLives <= 0) {
+            player.lives = 0;
+            levelCompleted = true; 
+        }
+    }
+
+    void resolveExitTouch(uintptr_t, uintptr_t) {
+        levelCompleted = true;
+    }
+
+    void resolveHealthPickup(uintptr_t, uintptr_t healthId) {
+        if (healthId >= healthPickups.size()) return;
+        HealthPickup& health = healthPickups[healthId];
+        if (!health.active) return;
+
+        health.active = false;
+        if (player.lives < 3) {
+            player.lives++;
+            createEvent("health_picked", 0.3f, health.shape.getPosition());
+            healthPicked++;
+        }
+        else {
+            player.bonusLives++;
+            createEvent("health_picked", 0.3f, health.shape.getPosition());
+            healthPicked++;
+        }
+    }
+
+    void resolveTrapTouch(uintptr_t, uintptr_t trapId) {
+        if (trapId >= traps.size()) return;
+        Trap& trap = traps[trapId];
+        if (!trap.active) return;
+
+        trap.active = false;
+
+        if (player.bonusLives > 0) {
+            player.bonusLives--;
+            createEvent("trap_triggered", -0.7f, trap.shape.getPosition());
+            trapsTriggered++;
+        }
+        else if (player.lives > 0) {
+            player.lives--;
+            createEvent("trap_triggered", -0.7f, trap.shape.getPosition());
+            trapsTriggered++;
         }
+
+        if (player.lives <= 0 && player.bonusLives <= 0) {
+            player.lives = 0;
+            levelCompleted = true;
+            createEvent("trap_triggered", -0.7f, trap.shape.getPosition());
+            trapsTriggered++;
+        }
+    }
+
+    void resolveKeyPickup(uintptr_t, uintptr_t keyId) {
+        if (keyId >= keys.size() || keys[keyId].collected) return;
+        keys[keyId].collected = true;
+        tileRenderer.setTile(keys[keyId].cell, EMPTY);
+        player.keys++;
+    }
+
+    void resolveDoorTouch(uintptr_t, uintptr_t doorId) {
+        if (doorId >= doors.size()) return;
+        Door& door = doors[doorId];
+        if (door.opened || player.keys <= 0) return;
+
+        door.opened = true;
+        navGrid.setWalkable(door.cell.x, door.cell.y, true);
+        player.keys--;
+        door.toDestroy = true;  
+        door.shape.setFillColor(sf::Color(139, 69, 19, 128));
+        tileRenderer.setTile(door.cell, EMPTY);
     }
 };
 
 void updateTraps(std::vector<Trap>& traps, b2World& world, float deltaTime) {
     for (auto it = traps.begin(); it != traps.end(); ) {
         if (!it->active) {
-            world.DestroyBody(it->body);
-            it = traps.erase(it);
+            if (it->body) {
+                world.DestroyBody(it->body);
+                it->body = nullptr;
+            }
         }
         else {
-            it->shape.rotate(sf::degrees(it->rotationSpeed * deltaTime));
-            ++it;
+            it->rotation = std::fmod(it->rotation + it->rotationSpeed * deltaTime, 360.0f);
         }
+        ++it;
     }
 }
 
@@ -1562,38 +4247,86 @@ void updatePlayer(Player& player, float deltaTime) {
     player.lastShotTime += deltaTime;
 }
 
-void updateHearts(std::vector<Heart>& hearts, const Player& player, int bonusHearts) {
-    hearts.clear();
-    for (int i = 0; i < player.lives; ++i) {
-        Heart h;
-        h.shape = sf::CircleShape(8.0f, 30);
-        h.shape.setFillColor(sf::Color::Red);
-        h.shape.setOrigin(sf::Vector2f(8.0f, 8.0f));
-        h.isBonus = false;
-        hearts.push_back(h);
-    }
-    for (int i = 0; i < bonusHearts; ++i) {
-        Heart h;
-        h.shape = sf::CircleShape(8.0f, 30);
-        h.shape.setFillColor(sf::Color::Yellow);
-        h.shape.setOrigin(sf::Vector2f(8.0f, 8.0f));
-        h.isBonus = true;
-        hearts.push_back(h);
-    }
-    for (size_t i = 0; i < hearts.size(); ++i) {
-        hearts[i].shape.setPosition(sf::Vector2f(20.0f + i * 21.0f, 20.0f));
+// Интерфейс в удерживаемом режиме: сердца и ключи лежат в одном закешированном
+// массиве вершин, который пересобирается только при смене жизней, бонусных
+// жизней, ключей или ширины окна. В обычном кадре остаётся одно сравнение и один draw.
+class Hud {
+public:
+    explicit Hud(const SpriteAtlas& atlas) : atlas(atlas) {}
+
+    void update(int playerLives, int playerBonusLives, int playerKeys, const sf::Vector2u& windowSize) {
+        if (built && playerLives == lives && playerBonusLives == bonusLives &&
+            playerKeys == keys && windowSize.x == windowWidth) {
+            return;
+        }
+        built = true;
+        lives = playerLives;
+        bonusLives = playerBonusLives;
+        keys = playerKeys;
+        windowWidth = windowSize.x;
+        rebuild();
+    }
+
+    void draw(sf::RenderTarget& target) const {
+        if (vertices.getVertexCount() > 0) {
+            target.draw(vertices, &atlas.getTexture());
+        }
+    }
+
+private:
+    static constexpr float HEART_RADIUS = 8.0f;
+
+    const SpriteAtlas& atlas;
+    sf::VertexArray vertices{ sf::PrimitiveType::Triangles };
+    bool built = false;
+    int lives = 0;
+    int bonusLives = 0;
+    int keys = 0;
+    unsigned int windowWidth = 0;
+
+    void rebuild() {
+        vertices.clear();
+        int heartCount = std::max(0, lives) + std::max(0, bonusLives);
+        for (int i = 0; i < heartCount; ++i) {
+            appendHeart(sf::Vector2f(20.0f + i * 21.0f, 20.0f), i < lives ? sf::Color::Red : sf::Color::Yellow);
+        }
+        for (int i = 0; i < keys; ++i) {
+            sf::Vector2f topLeft(windowWidth - 40.0f - i * 25.0f, 20.0f);
+            appendRect(topLeft - sf::Vector2f(1.0f, 1.0f), sf::Vector2f(17.0f, 32.0f), sf::Color::Black);
+            appendRect(topLeft, sf::Vector2f(15.0f, 30.0f), sf::Color::Yellow);
+        }
+    }
+
+    void appendHeart(const sf::Vector2f& center, sf::Color color) {
+        const SpriteAtlas::Region& region = atlas.getRegion(SPRITE_CIRCLE);
+        appendQuad(center + region.local.position * HEART_RADIUS, region.local.size * HEART_RADIUS,
+            region.texture.position, region.texture.size, color);
     }
-}
+
+    void appendRect(const sf::Vector2f& topLeft, const sf::Vector2f& size, sf::Color color) {
+        appendQuad(topLeft, size, atlas.getSolidTexCoord(), sf::Vector2f(0.0f, 0.0f), color);
+    }
+
+    void appendQuad(const sf::Vector2f& topLeft, const sf::Vector2f& size, const sf::Vector2f& texTopLeft,
+        const sf::Vector2f& texSize, sf::Color color) {
+        sf::Vector2f bottomRight = topLeft + size;
+        sf::Vector2f texBottomRight = texTopLeft + texSize;
+        vertices.append(sf::Vertex{ topLeft, color, texTopLeft });
+        vertices.append(sf::Vertex{ sf::Vector2f(bottomRight.x, topLeft.y), color, sf::Vector2f(texBottomRight.x, texTopLeft.y) });
+        vertices.append(sf::Vertex{ bottomRight, color, texBottomRight });
+        vertices.append(sf::Vertex{ topLeft, color, texTopLeft });
+        vertices.append(sf::Vertex{ bottomRight, color, texBottomRight });
+        vertices.append(sf::Vertex{ sf::Vector2f(topLeft.x, bottomRight.y), color, sf::Vector2f(texTopLeft.x, texBottomRight.y) });
+    }
+};
 
 void updateHealthPickups(std::vector<HealthPickup>& healthPickups, b2World& world) {
     for (auto it = healthPickups.begin(); it != healthPickups.end(); ) {
-        if (!it->active) {
+        if (!it->active && it->body) {
             world.DestroyBody(it->body);
-            it = healthPickups.erase(it);
-        }
-        else {
-            ++it;
+            it->body = nullptr;
         }
+        ++it;
     }
 }
 
@@ -1601,191 +4334,344 @@ void updateHealthPickupsAnimation(std::vector<HealthPickup>& healthPickups, floa
     for (auto& health : healthPickups) {
         if (health.active) {
             health.pulseTime += deltaTime * health.pulseSpeed;
-            float scale = 1.0f + sin(health.pulseTime) * health.pulseSize;
-            health.shape.setScale(sf::Vector2f(scale, scale));
         }
     }
 }
 
-void updateEnemies(std::vector<Enemy*>& enemies, const sf::Vector2f& playerPosition, b2World& world, float deltaTime, const std::vector<Door>& doors) {
-    sf::Vector2i playerCell(static_cast<int>(playerPosition.x / cellSize),
-        static_cast<int>(playerPosition.y / cellSize));
+// Планировщик уровня детализации ИИ: враги делятся на ярусы по расстоянию до игрока
+// и попаданию в камеру. Ближние обновляются каждый кадр, средние — раз в несколько
+// кадров, дальние — редко; пропущенное время копится и отдаётся при следующем тике.
+// Дорогая работа (перестроение патруля, запросы пути) ограничена бюджетом на кадр.
+class AIScheduler {
+public:
+    enum Tier { NEAR = 0, MID = 1, FAR = 2, TIER_COUNT = 3 };
+
+    static const int NEAR_DISTANCE = 7;           // в клетках
+    static const int MID_DISTANCE = 16;
+    static const int MAX_EXPENSIVE_PER_FRAME = 4;
+    static constexpr float MAX_ACCUMULATED_DELTA = 0.5f;
+
+    void beginFrame(EnemyStore& enemies, const sf::Vector2f& playerPosition, const sf::FloatRect& cameraRect,
+        float deltaTime) {
+        frame++;
+        expensiveBudget = MAX_EXPENSIVE_PER_FRAME;
+        for (int tier = 0; tier < TIER_COUNT; ++tier) {
+            tierCounts[tier] = 0;
+        }
+
+        float nearDistance = NEAR_DISTANCE * cellSize;
+        float midDistance = MID_DISTANCE * cellSize;
+        sf::FloatRect visibleRect(cameraRect.position - sf::Vector2f(cellSize, cellSize),
+            cameraRect.size + sf::Vector2f(2.0f * cellSize, 2.0f * cellSize));
+
+        for (size_t i = 0; i < enemies.size(); ++i) {
+            enemies.aiAccumulator[i] = std::min(enemies.aiAccumulator[i] + deltaTime, MAX_ACCUMULATED_DELTA);
+
+            float dx = enemies.position[i].x - playerPosition.x;
+            float dy = enemies.position[i].y - playerPosition.y;
+            float distanceSquared = dx * dx + dy * dy;
 
-    for (auto it = enemies.begin(); it != enemies.end(); ) {
-        Enemy* enemy = *it;
-        if (enemy->toDestroy) {
-            if (enemy->body) {
-                world.DestroyBody(enemy->body);
-                enemy->body = nullptr;
+            Tier tier = FAR;
+            if (distanceSquared <= nearDistance * nearDistance || visibleRect.contains(enemies.position[i])) {
+                tier = NEAR;
             }
-            delete enemy;
-            it = enemies.erase(it);
-            continue;
+            else if (distanceSquared <= midDistance * midDistance || enemies.hasFlag(i, EnemyStore::PURSUING)) {
+                tier = MID;
+            }
+            enemies.aiTier[i] = static_cast<uint8_t>(tier);
+            tierCounts[tier]++;
         }
+    }
 
-        if (enemy->health <= 0) {
-            enemy->toDestroy = true;
-            ++it;
-            continue;
+    // Тикает ли враг в этом кадре; фаза сдвинута по слоту хэндла, чтобы
+    // враги одного яруса не обновлялись в один и тот же кадр
+    bool shouldTick(const EnemyStore& enemies, size_t index) {
+        int tier = enemies.aiTier[index];
+        uint32_t interval = TICK_INTERVAL[tier];
+        uint32_t phase = (enemies.handle[index] & 0xFFFF) % interval;
+        if ((frame + phase) % interval != 0) {
+            return false;
         }
+        tickCounts[tier]++;
+        return true;
+    }
 
-        if (!enemy->body) {
-            ++it;
-            continue;
+    float consumeDelta(EnemyStore& enemies, size_t index) {
+        float delta = enemies.aiAccumulator[index];
+        enemies.aiAccumulator[index] = 0.0f;
+        return delta;
+    }
+
+    bool tryBeginExpensiveWork() {
+        if (expensiveBudget <= 0) {
+            deferredCount++;
+            return false;
         }
-        if (enemy->stunTimer > 0) {
-            enemy->stunTimer -= deltaTime;
-            enemy->body->SetLinearVelocity(b2Vec2(0, 0));
-            enemy->shape.setFillColor(sf::Color::Cyan);
-            ++it;
-            continue;
+        expensiveBudget--;
+        return true;
+    }
+
+    uint32_t getFrame() const { return frame; }
+
+    void printStats() const {
+        static const char* names[TIER_COUNT] = { "near", "mid", "far" };
+        std::cout << "AI tiers:";
+        for (int tier = 0; tier < TIER_COUNT; ++tier) {
+            std::cout << " " << names[tier] << "=" << tierCounts[tier]
+                << " (every " << TICK_INTERVAL[tier] << " frames, " << tickCounts[tier] << " ticks)";
         }
-        else {
-            enemy->shape.setFillColor(enemy->isStrong ? sf::Color::Magenta : sf::Color::Green);
+        std::cout << ", deferred expensive work: " << deferredCount << std::endl;
+    }
+
+    void resetStats() {
+        for (int tier = 0; tier < TIER_COUNT; ++tier) {
+            tickCounts[tier] = 0;
         }
+        deferredCount = 0;
+    }
 
-        sf::Vector2f enemyPos = enemy->shape.getPosition();
-        sf::Vector2i enemyCell(static_cast<int>(enemyPos.x / cellSize),
-            static_cast<int>(enemyPos.y / cellSize));
+private:
+    static constexpr uint32_t TICK_INTERVAL[TIER_COUNT] = { 1, 4, 12 };
 
-        float distanceToPlayer = std::sqrt(std::pow(playerCell.x - enemyCell.x, 2) +
-            std::pow(playerCell.y - enemyCell.y, 2));
-        bool hasLineOfSight = false;
-        if (distanceToPlayer <= 5.0f) {
-            hasLineOfSight = true;
-            sf::Vector2i dir = playerCell - enemyCell;
-            int steps = std::max(std::abs(dir.x), std::abs(dir.y));
+    uint32_t frame = 0;
+    int expensiveBudget = MAX_EXPENSIVE_PER_FRAME;
+    int tierCounts[TIER_COUNT] = {};
+    uint64_t tickCounts[TIER_COUNT] = {};
+    uint64_t deferredCount = 0;
+};
 
-            if (steps > 0) {
-                float dx = static_cast<float>(dir.x) / steps;
-                float dy = static_cast<float>(dir.y) / steps;
+struct EnemyTick {
+    uint32_t index;
+    float delta;
+};
 
-                for (int i = 1; i < steps; ++i) {
-                    int checkX = enemyCell.x + static_cast<int>(dx * i);
-                    int checkY = enemyCell.y + static_cast<int>(dy * i);
+const size_t ENEMY_DECISION_CHUNK = 32;
+
+// Решение одного врага: читает общие поля видимости и потока и пишет только
+// в собственные элементы хранилища. Скорость уходит в буфер velocity, а дорогая
+// работа (новый патруль, запрос пути) и всё, что трогает общие объекты (сервис
+// путей, фигура), остаётся последовательной фазе.
+void decideEnemy(EnemyStore& enemies, size_t i, float enemyDelta, const sf::Vector2f& playerPosition,
+    std::minstd_rand& rng) {
+    if (enemies.stunTimer[i] > 0) {
+        enemies.stunTimer[i] -= enemyDelta;
+        enemies.velocity[i] = b2Vec2(0, 0);
+        return;
+    }
 
-                    if (!isWalkable(checkX, checkY, doors)) {
-                        hasLineOfSight = false;
-                        break;
-                    }
-                }
+    sf::Vector2f enemyPos = enemies.position[i];
+    sf::Vector2i enemyCell(static_cast<int>(enemyPos.x / cellSize),
+        static_cast<int>(enemyPos.y / cellSize));
+
+    bool hasLineOfSight = playerFieldOfView.isVisible(enemyCell.x, enemyCell.y);
+    if (hasLineOfSight) {
+        enemies.setFlag(i, EnemyStore::SEEN_PLAYER, true);
+        enemies.setFlag(i, EnemyStore::PURSUING, true);
+        enemies.lastSeenPlayerTime[i] = 3.0f; 
+    }
+    else {
+        enemies.lastSeenPlayerTime[i] -= enemyDelta;
+        if (enemies.lastSeenPlayerTime[i] <= 0) {
+            enemies.setFlag(i, EnemyStore::PURSUING, false);
+            enemies.path[i].clear();
+        }
+    }
+    enemies.patrolChangeTimer[i] += enemyDelta;
+    if (enemies.patrolChangeTimer[i] >= 10.0f) {
+        enemies.setFlag(i, EnemyStore::NEEDS_PATROL, true);
+    }
+
+    if (enemies.hasFlag(i, EnemyStore::PURSUING) && enemies.hasFlag(i, EnemyStore::SEEN_PLAYER)) {
+        sf::Vector2i nextCell;
+        bool hasNextCell = playerFlowField.getNextCell(enemyCell, nextCell);
+        if (!hasNextCell && playerFlowField.isTruncated() && playerFlowField.getDistance(enemyCell) < 0) {
+            // Враг за пределами волны: асинхронный запрос пути; готовые ответы уже
+            // разложены по path до параллельной фазы, пока ответа нет — идём по прежнему
+            hasNextCell = nextCellOnPath(enemies.path[i], enemyCell, nextCell);
+            enemies.recalculatePathTimer[i] += enemyDelta;
+            if (!hasNextCell || enemies.recalculatePathTimer[i] >= 0.5f) {
+                enemies.setFlag(i, EnemyStore::NEEDS_REPATH, true);
             }
         }
-        if (hasLineOfSight) {
-            enemy->hasSeenPlayer = true;
-            enemy->isPursuing = true;
-            enemy->lastSeenPlayerTime = 3.0f; 
+        else {
+            enemies.path[i].clear();
+        }
+
+        if (hasNextCell) {
+            sf::Vector2f targetPos(nextCell.x * cellSize + cellSize / 2,
+                nextCell.y * cellSize + cellSize / 2);
+
+            b2Vec2 direction(targetPos.x - enemyPos.x, targetPos.y - enemyPos.y);
+            direction.Normalize();
+            enemies.velocity[i] = enemies.speed[i] * direction;
         }
         else {
-            enemy->lastSeenPlayerTime -= deltaTime;
-            if (enemy->lastSeenPlayerTime <= 0) {
-                enemy->isPursuing = false;
-                enemy->path.clear();
+            b2Vec2 direction(playerPosition.x - enemyPos.x, playerPosition.y - enemyPos.y);
+            direction.Normalize();
+            enemies.velocity[i] = enemies.speed[i] * direction;
+        }
+    }
+    else {
+        const auto& patrolPath = enemies.patrolPath[i];
+        if (patrolPath.empty()) {
+            enemies.setFlag(i, EnemyStore::NEEDS_PATROL, true);
+            enemies.velocity[i] = b2Vec2(0, 0);
+            return;
+        }
+
+        sf::Vector2i targetCell = patrolPath[enemies.currentPatrolPoint[i]];
+        sf::Vector2f targetPos(targetCell.x * cellSize + cellSize / 2,
+            targetCell.y * cellSize + cellSize / 2);
+
+        // Редко обновляемый враг проходит между тиками больше 5 пикселей,
+        // поэтому радиус прибытия растёт вместе с шагом
+        float arrivalRadius = std::max(5.0f, enemies.speed[i] * 0.7f * enemyDelta);
+        float dx = targetPos.x - enemyPos.x;
+        float dy = targetPos.y - enemyPos.y;
+        if (dx * dx + dy * dy < arrivalRadius * arrivalRadius) {
+            enemies.idleTimer[i] += enemyDelta;
+            enemies.velocity[i] = b2Vec2(0, 0);
+
+            int idleJitter = std::uniform_int_distribution<int>(0, 99)(rng);
+            if (enemies.idleTimer[i] >= 1.0f + idleJitter * 0.02f) {
+                enemies.idleTimer[i] = 0.0f;
+                enemies.currentPatrolPoint[i] = (enemies.currentPatrolPoint[i] + 1) % patrolPath.size();
             }
         }
-        enemy->patrolChangeTimer += deltaTime;
-        if (enemy->patrolChangeTimer >= 10.0f) {
-            enemy->patrolPath = createPatrolPath(enemyCell.x, enemyCell.y, doors);
-            enemy->currentPatrolPoint = 0;
-            enemy->patrolChangeTimer = 0.0f;
+        else {
+            b2Vec2 direction(dx, dy);
+            direction.Normalize();
+            enemies.velocity[i] = enemies.speed[i] * 0.7f * direction;
         }
+    }
+}
 
-        if (enemy->isPursuing && enemy->hasSeenPlayer) {
-            enemy->recalculatePathTimer += deltaTime;
-            if (enemy->recalculatePathTimer >= 0.1f || enemy->path.empty()) {
-                enemy->path = findPath(enemyCell, playerCell, doors);
-                enemy->recalculatePathTimer = 0.0f;
-            }
+// Обновление врагов в три фазы: последовательный отбор (удаление, LOD-тики),
+// параллельное принятие решений кусками по ENEMY_DECISION_CHUNK и последовательное
+// применение скоростей к b2Body вместе с бюджетируемой дорогой работой.
+void updateEnemies(EnemyStore& enemies, const sf::Vector2f& playerPosition, b2World& world,
+    PathRequestService& pathRequests, AIScheduler& scheduler, JobSystem& jobSystem) {
+    static std::vector<EnemyTick> ticks;
+    ticks.clear();
 
-            if (!enemy->path.empty() && enemy->path.size() > 1) {
-                sf::Vector2i nextCell = enemy->path[1];
-                if (isWalkable(nextCell.x, nextCell.y, doors)) {
-                    sf::Vector2f targetPos(nextCell.x * cellSize + cellSize / 2,
-                        nextCell.y * cellSize + cellSize / 2);
+    sf::Vector2i playerCell(static_cast<int>(playerPosition.x / cellSize),
+        static_cast<int>(playerPosition.y / cellSize));
+    playerFieldOfView.update(navGrid, playerCell, ENEMY_SIGHT_RADIUS);
 
-                    b2Vec2 direction(targetPos.x - enemyPos.x, targetPos.y - enemyPos.y);
-                    direction.Normalize();
-                    enemy->body->SetLinearVelocity(enemy->speed * direction);
-                }
-                else {
-                    enemy->isPursuing = false;
-                    enemy->path.clear();
-                }
-            }
-            else {
-                b2Vec2 direction(playerPosition.x - enemyPos.x, playerPosition.y - enemyPos.y);
-                direction.Normalize();
-                enemy->body->SetLinearVelocity(enemy->speed * direction);
+    bool needsFlowField = false;
+    for (size_t i = 0; i < enemies.size(); ) {
+        if (enemies.hasFlag(i, EnemyStore::TO_DESTROY)) {
+            if (enemies.body[i]) {
+                world.DestroyBody(enemies.body[i]);
             }
+            enemySpatialHash.remove(enemies.handle[i]);
+            enemies.remove(i);
+            continue;
+        }
+
+        if (enemies.health[i] <= 0) {
+            enemies.setFlag(i, EnemyStore::TO_DESTROY, true);
+            ++i;
+            continue;
         }
-        else {
-            enemy->path.clear();
-            if (enemy->patrolPath.empty()) {
-                enemy->patrolPath = createPatrolPath(enemyCell.x, enemyCell.y, doors);
-                enemy->currentPatrolPoint = 0;
-            }
 
-            if (!enemy->patrolPath.empty()) {
-                sf::Vector2i targetCell = enemy->patrolPath[enemy->currentPatrolPoint];
-                sf::Vector2f targetPos(targetCell.x * cellSize + cellSize / 2,
-                    targetCell.y * cellSize + cellSize / 2);
+        // Враги в выключенных областях физики не думают
+        if (!enemies.body[i] || !enemies.body[i]->IsEnabled()) {
+            ++i;
+            continue;
+        }
+        if (!scheduler.shouldTick(enemies, i)) {
+            syncEnemyPosition(enemies, i);
+            ++i;
+            continue;
+        }
+        ticks.push_back({ static_cast<uint32_t>(i), scheduler.consumeDelta(enemies, i) });
 
-                float distanceToTarget = std::sqrt(std::pow(targetPos.x - enemyPos.x, 2) +
-                    std::pow(targetPos.y - enemyPos.y, 2));
+        sf::Vector2i enemyCell(static_cast<int>(enemies.position[i].x / cellSize),
+            static_cast<int>(enemies.position[i].y / cellSize));
+        if (enemies.hasFlag(i, EnemyStore::PURSUING) || playerFieldOfView.isVisible(enemyCell.x, enemyCell.y)) {
+            needsFlowField = true;
+        }
+        ++i;
+    }
 
-                if (distanceToTarget < 5.0f) {
-                    enemy->idleTimer += deltaTime;
-                    enemy->body->SetLinearVelocity(b2Vec2(0, 0));
+    // Поле потока перестраивается до параллельной фазы, дальше его только читают
+    if (needsFlowField) {
+        playerFlowField.update(navGrid, playerCell);
+    }
 
-                    if (enemy->idleTimer >= 1.0f + (rand() % 100) * 0.02f) {
-                        enemy->idleTimer = 0.0f;
-                        enemy->currentPatrolPoint = (enemy->currentPatrolPoint + 1) % enemy->patrolPath.size();
-                    }
-                }
-                else {
-                    b2Vec2 direction(targetPos.x - enemyPos.x, targetPos.y - enemyPos.y);
-                    direction.Normalize();
-                    enemy->body->SetLinearVelocity(enemy->speed * 0.7f * direction);
-                }
+    pathRequests.drainResults([&](uint32_t requester, std::vector<sf::Vector2i>& path) {
+        int i = enemies.indexOf(requester);
+        if (i >= 0) {
+            enemies.path[i].swap(path);
+        }
+    });
+
+    // У каждого куска свой генератор, засеянный номером кадра и куска, поэтому
+    // результат не зависит от того, какой поток взял кусок
+    uint32_t frameSeed = scheduler.getFrame() * 2654435761u;
+    jobSystem.parallelFor(ticks.size(), ENEMY_DECISION_CHUNK,
+        [&](size_t begin, size_t end, size_t chunk) {
+            std::minstd_rand rng(frameSeed ^ static_cast<uint32_t>(chunk * 0x9E3779B9u + 1));
+            for (size_t t = begin; t < end; ++t) {
+                decideEnemy(enemies, ticks[t].index, ticks[t].delta, playerPosition, rng);
             }
+        });
+
+    for (const EnemyTick& tick : ticks) {
+        size_t i = tick.index;
+        sf::Vector2i enemyCell(static_cast<int>(enemies.position[i].x / cellSize),
+            static_cast<int>(enemies.position[i].y / cellSize));
+
+        if (enemies.hasFlag(i, EnemyStore::NEEDS_PATROL) && scheduler.tryBeginExpensiveWork()) {
+            enemies.patrolPath[i] = createPatrolPath(enemyCell.x, enemyCell.y);
+            enemies.currentPatrolPoint[i] = 0;
+            enemies.patrolChangeTimer[i] = 0.0f;
+            enemies.setFlag(i, EnemyStore::NEEDS_PATROL, false);
         }
-        if (enemy->body) {
-            enemy->shape.setPosition(sf::Vector2f(enemy->body->GetPosition().x, enemy->body->GetPosition().y));
+        if (enemies.hasFlag(i, EnemyStore::NEEDS_REPATH)) {
+            EnemyHandle handle = enemies.handle[i];
+            if (!pathRequests.isPending(handle) && scheduler.tryBeginExpensiveWork()) {
+                pathRequests.submit(handle, enemyCell, playerCell);
+                enemies.recalculatePathTimer[i] = 0.0f;
+            }
+            enemies.setFlag(i, EnemyStore::NEEDS_REPATH, false);
         }
 
-        ++it;
+        bool isStrong = enemies.hasFlag(i, EnemyStore::STRONG);
+        enemies.shape[i].setFillColor(enemies.stunTimer[i] > 0 ? sf::Color::Cyan :
+            isStrong ? sf::Color::Magenta : sf::Color::Green);
+        enemies.body[i]->SetLinearVelocity(enemies.velocity[i]);
+        syncEnemyPosition(enemies, i);
     }
 }
 
 void clearGameObjects(b2World& world,
-    std::vector<Wall>& walls,
-    std::vector<Pit>& pits,
-    std::vector<Enemy*>& enemies,
-    std::vector<Bullet*>& bullets,
+    EnemyStore& enemies,
+    BulletPool& bullets,
+    ProjectileSystem& projectiles,
     std::vector<HealthPickup>& healthPickups,
     std::vector<Trap>& traps,
     std::vector<Key>& keys,
     std::vector<Door>& doors) {
-    for (auto* bullet : bullets) {
-        world.DestroyBody(bullet->body);
-        delete bullet;
-    }
-    bullets.clear();
-    for (auto* enemy : enemies) {
-        if (enemy->body) {  
-            world.DestroyBody(enemy->body);
+    bullets.releaseAll();
+    projectiles.clear();
+    for (b2Body* enemyBody : enemies.body) {
+        if (enemyBody) {  
+            world.DestroyBody(enemyBody);
         }
-        delete enemy;
     }
     enemies.clear();
+    enemySpatialHash.clear();
+    trapRenderIndex.clear();
+    healthRenderIndex.clear();
 
-    for (auto& wall : walls) {
-        world.DestroyBody(wall.body);
-    }
-    walls.clear();
+    staticGeometry.clear(world);
 
     for (auto& trap : traps) {
-        world.DestroyBody(trap.body);
+        if (trap.body) {
+            world.DestroyBody(trap.body);
+        }
     }
     traps.clear();
 
@@ -1795,86 +4681,68 @@ void clearGameObjects(b2World& world,
     keys.clear();
 
     for (auto& door : doors) {
-        world.DestroyBody(door.body);
+        if (door.body) {
+            world.DestroyBody(door.body);
+        }
     }
     doors.clear();
 
     for (auto& health : healthPickups) {
-        world.DestroyBody(health.body);
+        if (health.body) {
+            world.DestroyBody(health.body);
+        }
     }
     healthPickups.clear();
-
-    pits.clear(); 
 }
 
 void resetContactListener(b2World& world, ContactListener*& listener,
-    std::vector<Bullet*>& bullets, std::vector<Enemy*>& enemies,
+    BulletPool& bullets, EnemyStore& enemies,
     Player& player, Exit& exit, std::vector<HealthPickup>& healthPickups,
     bool& levelCompleted, std::vector<Trap>& traps,
     std::vector<Key>& keys, std::vector<Door>& doors,
-    int& pd, int& ek, int& tt, int& hp) {
+    int& pd, int& ek, int& tt, int& hp, GameEventSink& gameEvents) {
 
     world.SetContactListener(nullptr);
     delete listener;
     listener = new ContactListener(bullets, enemies, player, exit, healthPickups,
-        levelCompleted, world, traps, keys, doors, pd, ek, tt, hp);
+        levelCompleted, world, traps, keys, doors, pd, ek, tt, hp, gameEvents);
     world.SetContactListener(listener);
 }
 
-void createBullet(std::vector<Bullet*>& bullets, Player& player, b2World& world) {
-    Bullet* bullet = new Bullet();
-    bullet->shape = sf::CircleShape(5.0f);
-    bullet->shape.setFillColor(sf::Color::Red);
-    bullet->shape.setOrigin(sf::Vector2f(5.0f, 5.0f));
-
+void createBullet(BulletPool& bullets, ProjectileSystem& projectiles, Player& player, const WeaponType& weapon) {
     float radianAngle = (player.angle - 90.0f) * b2_pi / 180.0f;
     float offset = 22.0f;
     sf::Vector2f startPos = player.shape.getPosition() + sf::Vector2f(cos(radianAngle) * offset, sin(radianAngle) * offset);
-    bullet->shape.setPosition(startPos);
-    bullet->direction = b2Vec2(cos(radianAngle), sin(radianAngle));
-
-    b2BodyDef bulletDef;
-    bulletDef.type = b2_dynamicBody;
-    bulletDef.position.Set(startPos.x, startPos.y);
-    bulletDef.bullet = true;
-    bullet->body = world.CreateBody(&bulletDef);
-
-    b2CircleShape circle;
-    circle.m_radius = 5.0f;
-
-    b2FixtureDef fixtureDef;
-    fixtureDef.shape = &circle;
-    fixtureDef.density = 1.0f;
-    fixtureDef.isSensor = false;
-    fixtureDef.filter.categoryBits = BULLET_CATEGORY;
-    fixtureDef.filter.maskBits = ENEMY_CATEGORY | WALL_CATEGORY | DOOR_CATEGORY;  
-    bullet->body->CreateFixture(&fixtureDef);
-
-    bullet->body->SetLinearVelocity(60.0f * bullet->direction);
-    bullets.push_back(bullet);
+    b2Vec2 direction(cos(radianAngle), sin(radianAngle));
+
+    if (weapon.mode == ProjectileMode::Raycast) {
+        // Луч идёт из центра игрока: дуло может оказаться внутри стены или
+        // прижатого врага, а RayCast Box2D не видит фикстуру, содержащую начало
+        // луча. Фикстуру самого игрока отсекает HIT_MASK, дальность считается от дула
+        sf::Vector2f center = player.shape.getPosition();
+        projectiles.spawn(center, direction, weapon.speed, weapon.maxDistance + offset);
+        return;
+    }
+    if (Bullet* bullet = bullets.acquire(startPos, direction, weapon.speed)) {
+        bullet->maxDistance = weapon.maxDistance;
+    }
 }
 
-void updateBullets(std::vector<Bullet*>& bullets, b2World& world) {
-    for (auto it = bullets.begin(); it != bullets.end();) {
-        Bullet* bullet = *it;
-
-        bullet->shape.setPosition(sf::Vector2f(bullet->body->GetPosition().x, bullet->body->GetPosition().y));
+void updateBullets(BulletPool& bullets, float deltaTime) {
+    for (size_t i = 0; i < bullets.size(); ) {
+        Bullet& bullet = bullets[i];
 
-        b2Filter filter;
-        filter.categoryBits = BULLET_CATEGORY;
-        filter.maskBits = ENEMY_CATEGORY | WALL_CATEGORY | DOOR_CATEGORY;
-        bullet->body->GetFixtureList()->SetFilterData(filter);
-        b2Vec2 vel = bullet->body->GetLinearVelocity();
-        bullet->distanceTravelled += sqrt(vel.x * vel.x + vel.y * vel.y) * (1.0f / 60.0f);
+        bullet.shape.setPosition(sf::Vector2f(bullet.body->GetPosition().x, bullet.body->GetPosition().y));
+        bullets.updateIndex(i);
 
+        b2Vec2 vel = bullet.body->GetLinearVelocity();
+        bullet.distanceTravelled += sqrt(vel.x * vel.x + vel.y * vel.y) * deltaTime;
 
-        if (bullet->toDestroy || bullet->distanceTravelled > bullet->maxDistance) {
-            world.DestroyBody(bullet->body);
-            delete bullet;
-            it = bullets.erase(it);
+        if (bullet.toDestroy || bullet.distanceTravelled > bullet.maxDistance) {
+            bullets.release(i);
         }
         else {
-            ++it;
+            ++i;
         }
     }
 }
@@ -1883,47 +4751,63 @@ void updateDoors(std::vector<Door>& doors, b2World& world) {
     for (auto it = doors.begin(); it != doors.end(); ) {
         if (it->toDestroy) {
             world.DestroyBody(it->body);
-            it = doors.erase(it);
-        }
-        else {
-            ++it;
+            it->body = nullptr;
+            it->toDestroy = false;
+            navGrid.setWalkable(it->cell.x, it->cell.y, true);
         }
+        ++it;
     }
 }
 
-void drawKeys(sf::RenderWindow& window, const Player& player) {
-    for (int i = 0; i < player.keys; ++i) {
-        sf::RectangleShape keyShape(sf::Vector2f(15.0f, 30.0f));
-        keyShape.setFillColor(sf::Color::Yellow);
-        keyShape.setOutlineColor(sf::Color::Black);
-        keyShape.setOutlineThickness(1.0f);
-        keyShape.setPosition(sf::Vector2f(window.getSize().x - 40.0f - i * 25.0f, 20.0f));
-        window.draw(keyShape);
-    }
+EnemyHandle createEnemy(b2World& world, EnemyStore& enemies, const sf::Vector2f& position, bool isStrong) {
+    float radius = isStrong ? 15.0f : 12.0f;
+
+    b2BodyDef enemyDef;
+    enemyDef.type = b2_dynamicBody;
+    enemyDef.position.Set(position.x, position.y);
+    b2Body* body = world.CreateBody(&enemyDef);
+
+    b2CircleShape enemyShape;
+    enemyShape.m_radius = radius;
+
+    b2FixtureDef enemyFixture;
+    enemyFixture.shape = &enemyShape;
+    enemyFixture.density = 1.0f;
+    enemyFixture.friction = 0.3f;
+    enemyFixture.filter.categoryBits = ENEMY_CATEGORY;
+    enemyFixture.filter.maskBits = PLAYER_CATEGORY | WALL_CATEGORY | BULLET_CATEGORY | ENEMY_CATEGORY | DOOR_CATEGORY;
+    body->CreateFixture(&enemyFixture);
+
+    EnemyHandle handle = isStrong ? enemies.add(body, position, 75.0f, 5, true)
+        : enemies.add(body, position, 150.0f, 3, false);
+    sf::CircleShape& shape = enemies.shape.back();
+    shape = sf::CircleShape(radius, 30);
+    shape.setFillColor(isStrong ? sf::Color::Magenta : sf::Color::Green);
+    shape.setOrigin(sf::Vector2f(radius, radius));
+    shape.setPosition(position);
+    tagFixtures(body, handle);
+    enemySpatialHash.insert(handle, position);
+    return handle;
 }
 
 void parseMap(const std::vector<std::vector<int>>& map, float cellSize,
-    b2World& world, Player& player, std::vector<Wall>& walls,
-    std::vector<Pit>& pits, std::vector<Enemy*>& enemies, Exit& exit, std::vector<HealthPickup>& healthPickups, std::vector<Trap>& traps, std::vector<Key>& keys, std::vector<Door>& doors) {
-    currentLevelMap = map;
+    b2World& world, Player& player, EnemyStore& enemies, Exit& exit, std::vector<HealthPickup>& healthPickups, std::vector<Trap>& traps, std::vector<Key>& keys, std::vector<Door>& doors) {
+    navGrid.build(map);
+    if (navGrid.getWidth() * navGrid.getHeight() >= HIERARCHICAL_PATH_MIN_CELLS) {
+        hierarchicalPathfinder.build(navGrid);
+    }
+    staticGeometry.build(map, cellSize, world);
+    physicsActivation.build(navGrid);
+    tileRenderer.build(map);
     for (size_t y = 0; y < map.size(); ++y) {
         for (size_t x = 0; x < map[y].size(); ++x) {
             sf::Vector2f position(x * cellSize + cellSize / 2, y * cellSize + cellSize / 2);
             sf::Vector2f size(cellSize, cellSize);
 
             switch (map[y][x]) {
-            case WALL: {
-                walls.push_back(createWall(world, position, size));
-                break;
-            }
-
-            case PIT: {
-                pits.push_back(createPit(position, size));
-                break;
-            }
-
             case PLAYER: {
                 player.shape.setPosition(position);
+                player.previousPosition = position;
                 player.body->SetTransform(b2Vec2(position.x, position.y), 0);
 
                 b2Fixture* playerFixture = player.body->GetFixtureList();
@@ -1940,91 +4824,604 @@ void parseMap(const std::vector<std::vector<int>>& map, float cellSize,
             }
 
             case HEALTH: {
-                healthPickups.push_back(createHealthPickup(world, position));
+                healthPickups.push_back(createHealthPickup(world, position, static_cast<uint32_t>(healthPickups.size())));
                 break;
             }
 
             case KEY: {
-                keys.push_back(createKey(world, position));
+                keys.push_back(createKey(world, position, static_cast<uint32_t>(keys.size())));
                 break;
             }
             case DOOR: {
-                doors.push_back(createDoor(world, position, sf::Vector2f(cellSize, cellSize)));
+                doors.push_back(createDoor(world, position, sf::Vector2f(cellSize, cellSize),
+                    static_cast<uint32_t>(doors.size())));
                 break;
             }
 
             case ENEMY: {
-                Enemy* enemy = new Enemy();
-                enemy->shape = sf::CircleShape(12.0f, 30);
-                enemy->shape.setFillColor(sf::Color::Green);
-                enemy->shape.setOrigin(sf::Vector2f(12.0f, 12.0f)); 
-                enemy->speed = 150.0f;
-                enemy->health = 3;
-                enemy->isStrong = false;
-
-                b2BodyDef enemyDef;
-                enemyDef.type = b2_dynamicBody;
-                enemyDef.position.Set(position.x, position.y);
-                enemy->body = world.CreateBody(&enemyDef);
-
-                b2CircleShape enemyShape;
-                enemyShape.m_radius = 12.0f;
-
-                b2FixtureDef enemyFixture;
-                enemyFixture.shape = &enemyShape;
-                enemyFixture.density = 1.0f;
-                enemyFixture.friction = 0.3f; 
-                enemyFixture.filter.categoryBits = ENEMY_CATEGORY;
-                enemyFixture.filter.maskBits = PLAYER_CATEGORY | WALL_CATEGORY | BULLET_CATEGORY | ENEMY_CATEGORY;
-                enemy->body->CreateFixture(&enemyFixture);
-
-                enemies.push_back(enemy);
+                createEnemy(world, enemies, position, false);
                 break;
             }
             case TRAP: {
-                traps.push_back(createTrap(world, position));
+                traps.push_back(createTrap(world, position, static_cast<uint32_t>(traps.size())));
                 std::cout << "Trap created at: " << position.x << ", " << position.y << std::endl;
                 break;
             }
 
             case STRONG_ENEMY: {
-                Enemy* enemy = new Enemy();
-                enemy->shape = sf::CircleShape(15.0f, 30);
-                enemy->shape.setFillColor(sf::Color::Magenta);
-                enemy->shape.setOrigin(sf::Vector2f(15.0f, 15.0f)); 
-                enemy->speed = 75.0f;
-                enemy->health = 5;
-                enemy->isStrong = true;
-
-                b2BodyDef enemyDef;
-                enemyDef.type = b2_dynamicBody;
-                enemyDef.position.Set(position.x, position.y);
-                enemy->body = world.CreateBody(&enemyDef);
-
-                b2CircleShape enemyShape;
-                enemyShape.m_radius = 15.0f;
-
-                b2FixtureDef enemyFixture;
-                enemyFixture.shape = &enemyShape;
-                enemyFixture.density = 1.0f;
-                enemyFixture.friction = 0.3f;
-                enemyFixture.filter.categoryBits = ENEMY_CATEGORY;
-                enemyFixture.filter.maskBits = PLAYER_CATEGORY | WALL_CATEGORY | BULLET_CATEGORY | ENEMY_CATEGORY;
-                enemy->body->CreateFixture(&enemyFixture);
-
-                enemies.push_back(enemy);
+                createEnemy(world, enemies, position, true);
                 break;
             }
             }
         }
     }
+
+    trapRenderIndex.clear();
+    for (size_t i = 0; i < traps.size(); ++i) {
+        trapRenderIndex.insert(static_cast<uint32_t>(i), traps[i].shape.getPosition());
+    }
+    healthRenderIndex.clear();
+    for (size_t i = 0; i < healthPickups.size(); ++i) {
+        healthRenderIndex.insert(static_cast<uint32_t>(i), healthPickups[i].shape.getPosition());
+    }
+}
+
+struct PathBenchmarkStats {
+    double referenceMs = 0.0;
+    double engineMs = 0.0;
+    double jumpPointMs = 0.0;
+    long long engineExpansions = 0;
+    long long jumpPointExpansions = 0;
+    long long queries = 0;
+    int mismatches = 0;
+    int lengthMismatches = 0;
+    float openRatio = 0.0f;
+    int maps = 0;
+};
+
+void benchmarkPathfindingMap(const std::vector<std::vector<int>>& map, std::mt19937& rng, PathBenchmarkStats& stats) {
+    const int queriesPerMap = 200;
+    const int repeats = 20;
+    PathFinder pathFinder;
+    std::vector<sf::Vector2i> path;
+    std::vector<sf::Vector2i> jumpPath;
+
+    navGrid.build(map);
+
+    std::vector<sf::Vector2i> openCells;
+    for (int y = 0; y < navGrid.getHeight(); ++y) {
+        for (int x = 0; x < navGrid.getWidth(); ++x) {
+            if (isWalkable(x, y)) {
+                openCells.emplace_back(x, y);
+            }
+        }
+    }
+    if (openCells.size() < 2) return;
+
+    std::vector<std::pair<sf::Vector2i, sf::Vector2i>> queries;
+    for (int i = 0; i < queriesPerMap; ++i) {
+        queries.emplace_back(openCells[rng() % openCells.size()], openCells[rng() % openCells.size()]);
+    }
+
+    for (const auto& [start, end] : queries) {
+        pathFinder.findPath(navGrid, start, end, path);
+        stats.engineExpansions += pathFinder.getLastExpansions();
+        if (path != findPathReference(start, end)) {
+            stats.mismatches++;
+        }
+        pathFinder.findPathJumpPoint(navGrid, start, end, jumpPath);
+        stats.jumpPointExpansions += pathFinder.getLastExpansions();
+        if (jumpPath.size() != path.size()) {
+            stats.lengthMismatches++;
+        }
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const auto& [start, end] : queries) {
+            findPathReference(start, end);
+        }
+    }
+    auto t1 = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const auto& [start, end] : queries) {
+            pathFinder.findPath(navGrid, start, end, path);
+        }
+    }
+    auto t2 = std::chrono::steady_clock::now();
+    for (int r = 0; r < repeats; ++r) {
+        for (const auto& [start, end] : queries) {
+            pathFinder.findPathJumpPoint(navGrid, start, end, jumpPath);
+        }
+    }
+    auto t3 = std::chrono::steady_clock::now();
+
+    stats.referenceMs += std::chrono::duration<double, std::milli>(t1 - t0).count() / repeats;
+    stats.engineMs += std::chrono::duration<double, std::milli>(t2 - t1).count() / repeats;
+    stats.jumpPointMs += std::chrono::duration<double, std::milli>(t3 - t2).count() / repeats;
+    stats.queries += static_cast<long long>(queries.size());
+    stats.openRatio += static_cast<float>(navGrid.getOpenCellCount()) / (navGrid.getWidth() * navGrid.getHeight());
+    stats.maps++;
+}
+
+void printPathBenchmarkStats(const std::string& label, const PathBenchmarkStats& stats) {
+    if (stats.queries == 0) {
+        std::cout << label << ": no walkable maps generated" << std::endl;
+        return;
+    }
+    double perQuery = 1000.0 / stats.queries;
+    std::cout << label << " (" << stats.maps << " maps, open ratio " << stats.openRatio / stats.maps
+        << ", " << stats.queries << " queries)" << std::endl;
+    std::cout << "  reference A*: " << stats.referenceMs * perQuery << " us/query" << std::endl;
+    std::cout << "  heap A*:      " << stats.engineMs * perQuery << " us/query, "
+        << static_cast<double>(stats.engineExpansions) / stats.queries << " expansions/query" << std::endl;
+    std::cout << "  JPS:          " << stats.jumpPointMs * perQuery << " us/query, "
+        << static_cast<double>(stats.jumpPointExpansions) / stats.queries << " expansions/query" << std::endl;
+    std::cout << "  heap A* speedup over reference: " << stats.referenceMs / std::max(stats.engineMs, 1e-9) << "x" << std::endl;
+    std::cout << "  JPS speedup over heap A*:       " << stats.engineMs / std::max(stats.jumpPointMs, 1e-9) << "x" << std::endl;
+    std::cout << "  path mismatches (heap A* vs reference): " << stats.mismatches << std::endl;
+    std::cout << "  length mismatches (JPS vs A*):          " << stats.lengthMismatches << std::endl;
+}
+
+// Фиксированный шаг симуляции: время кадра копится в аккумуляторе и тратится
+// тиками длиной 1 / tickRate. За кадр выполняется не больше maxCatchUpSteps
+// тиков; всё, что сверх, отбрасывается, иначе долгий кадр порождает ещё более
+// долгий. Остаток аккумулятора даёт коэффициент интерполяции для отрисовки.
+class FixedTimestep {
+public:
+    static constexpr float MAX_FRAME_TIME = 0.25f;
+
+    FixedTimestep(float tickRate, int maxCatchUpSteps)
+        : tickDuration(1.0f / tickRate), maxCatchUpSteps(maxCatchUpSteps) {}
+
+    // Сколько тиков симуляции выполнить в этом кадре
+    int beginFrame(float frameTime) {
+        accumulator += std::min(frameTime, MAX_FRAME_TIME);
+        int steps = static_cast<int>(accumulator / tickDuration);
+        if (steps > maxCatchUpSteps) {
+            droppedTicks += steps - maxCatchUpSteps;
+            steps = maxCatchUpSteps;
+            accumulator = steps * tickDuration;
+        }
+        accumulator -= steps * tickDuration;
+        return steps;
+    }
+
+    void reset() {
+        accumulator = 0.0f;
+    }
+
+    // Доля тика, прошедшая после последнего шага: 0 — предыдущее состояние, 1 — текущее
+    float getAlpha() const { return accumulator / tickDuration; }
+    float getTickDuration() const { return tickDuration; }
+    uint64_t getDroppedTicks() const { return droppedTicks; }
+
+private:
+    float tickDuration;
+    int maxCatchUpSteps;
+    float accumulator = 0.0f;
+    uint64_t droppedTicks = 0;
+};
+
+sf::Vector2f lerpPosition(const sf::Vector2f& from, const sf::Vector2f& to, float alpha) {
+    return from + (to - from) * alpha;
+}
+
+// Неизменяемый снимок кадра для отрисовки: уже отсечённые по камере фигуры с
+// позициями до и после тика, состояние HUD и счётчики. Снимок строится в потоке
+// симуляции и дальше читается только потоком отрисовки.
+struct RenderSnapshot {
+    // Спрайт атласа; для круга scale — радиус
+    struct Item {
+        sf::Vector2f previous;
+        sf::Vector2f current;
+        sf::Color color;
+        SpriteId sprite = SPRITE_CIRCLE;
+        float scale = 1.0f;
+        float rotation = 0.0f;
+    };
+
+    std::vector<Item> items;
+    sf::Vector2f cameraPrevious;
+    sf::Vector2f cameraCurrent;
+    int lives = 0;
+    int bonusLives = 0;
+    int keys = 0;
+    sf::Vector2u windowSize;   // из событий главного потока: окно читать из отрисовки нельзя
+    bool showOverlay = false;
+    bool valid = false;
+    RenderStats stats;
+    std::chrono::steady_clock::time_point publishedAt;
+    float tickDuration = 1.0f / 60.0f;
+
+    void addSprite(SpriteId sprite, const sf::Vector2f& previous, const sf::Vector2f& current, float rotation,
+        sf::Color color, float scale = 1.0f) {
+        Item item;
+        item.previous = previous;
+        item.current = current;
+        item.color = color;
+        item.sprite = sprite;
+        item.scale = scale;
+        item.rotation = rotation;
+        items.push_back(item);
+    }
+};
+
+// Тройной буфер снимков: симуляция пишет в свой буфер и обменивает его со
+// средним, отрисовка забирает средний, только если там появился свежий снимок.
+// Ни одна сторона не ждёт другую, а буферы с их векторами переиспользуются.
+class SnapshotTripleBuffer {
+public:
+    RenderSnapshot& writeBuffer() { return buffers[writeIndex]; }
+
+    void publish() {
+        int previous = middle.exchange(writeIndex | FRESH);
+        writeIndex = previous & INDEX_MASK;
+    }
+
+    // Забирает свежий снимок, если он есть; иначе остаётся прежний
+    bool acquire() {
+        if (!(middle.load() & FRESH)) return false;
+        int previous = middle.exchange(readIndex);
+        readIndex = previous & INDEX_MASK;
+        return true;
+    }
+
+    const RenderSnapshot& readBuffer() const { return buffers[readIndex]; }
+
+private:
+    static const int INDEX_MASK = 3;
+    static const int FRESH = 4;
+
+    std::array<RenderSnapshot, 3> buffers;
+    int writeIndex = 0;
+    int readIndex = 1;
+    std::atomic<int> middle{ 2 };
+};
+
+// Заполняет снимок текущим состоянием мира; камера — вид с центром на игроке
+void buildRenderSnapshot(RenderSnapshot& snapshot, const Player& player, const EnemyStore& enemies,
+    const BulletPool& bullets, const ProjectileSystem& projectiles, const std::vector<HealthPickup>& healthPickups,
+    const std::vector<Trap>& traps, const sf::View& view, std::vector<uint32_t>& visibleIds) {
+    snapshot.items.clear();
+    snapshot.cameraPrevious = player.previousPosition;
+    snapshot.cameraCurrent = sf::Vector2f(player.body->GetPosition().x, player.body->GetPosition().y);
+
+    // Запас в две клетки покрывает радиус крупных фигур и сдвиг камеры за тик
+    sf::Vector2f margin(2.0f * cellSize, 2.0f * cellSize);
+    sf::FloatRect cullRect(snapshot.cameraCurrent - view.getSize() / 2.0f - margin, view.getSize() + 2.0f * margin);
+    RenderStats& stats = snapshot.stats;
+
+    // Подобранные аптечки и сработавшие ловушки остаются в векторах и считаются отсечёнными
+    int drawnCount = 0;
+    healthRenderIndex.queryAABB(cullRect, visibleIds);
+    for (uint32_t id : visibleIds) {
+        const HealthPickup& health = healthPickups[id];
+        if (health.active) {
+            float pulse = 1.0f + sin(health.pulseTime) * health.pulseSize;
+            snapshot.addSprite(SPRITE_CIRCLE, health.shape.getPosition(), health.shape.getPosition(), 0.0f,
+                health.shape.getFillColor(), health.shape.getRadius() * pulse);
+            drawnCount++;
+        }
+    }
+    stats.set(RenderStats::HEALTH, drawnCount, static_cast<int>(healthPickups.size()));
+
+    drawnCount = 0;
+    trapRenderIndex.queryAABB(cullRect, visibleIds);
+    for (uint32_t id : visibleIds) {
+        const Trap& trap = traps[id];
+        if (trap.active) {
+            snapshot.addSprite(SPRITE_TRAP, trap.shape.getPosition(), trap.shape.getPosition(), trap.rotation,
+                trap.shape.getFillColor());
+            drawnCount++;
+        }
+    }
+    stats.set(RenderStats::TRAPS, drawnCount, static_cast<int>(traps.size()));
+
+    snapshot.addSprite(SPRITE_CIRCLE, snapshot.cameraPrevious, snapshot.cameraCurrent, 0.0f,
+        player.shape.getFillColor(), player.shape.getRadius());
+    snapshot.addSprite(SPRITE_ARROW, snapshot.cameraPrevious, snapshot.cameraCurrent, player.angle,
+        player.directionArc.getFillColor());
+
+    drawnCount = 0;
+    enemySpatialHash.queryAABB(cullRect, visibleIds);
+    for (uint32_t handle : visibleIds) {
+        int i = enemies.indexOf(handle);
+        if (i >= 0 && enemies.health[i] > 0) {
+            snapshot.addSprite(SPRITE_CIRCLE, enemies.previousPosition[i], enemies.position[i], 0.0f,
+                enemies.shape[i].getFillColor(), enemies.shape[i].getRadius());
+            drawnCount++;
+        }
+    }
+    stats.set(RenderStats::ENEMIES, drawnCount, static_cast<int>(enemies.size()));
+
+    bullets.getIndex().queryAABB(cullRect, visibleIds);
+    for (uint32_t slot : visibleIds) {
+        const Bullet& bullet = bullets.fromSlot(slot);
+        sf::Vector2f position(bullet.body->GetPosition().x, bullet.body->GetPosition().y);
+        snapshot.addSprite(SPRITE_CIRCLE, bullet.previousPosition, position, 0.0f,
+            bullet.shape.getFillColor(), bullet.shape.getRadius());
+    }
+    stats.set(RenderStats::BULLETS, static_cast<int>(visibleIds.size()), static_cast<int>(bullets.size()));
+
+    projectiles.getIndex().queryAABB(cullRect, visibleIds);
+    for (uint32_t id : visibleIds) {
+        const ProjectileSystem::Projectile& projectile = projectiles[id];
+        snapshot.addSprite(SPRITE_CIRCLE, projectile.previousPosition, projectile.position, 0.0f,
+            sf::Color::Yellow, 3.0f);
+    }
+    stats.set(RenderStats::PROJECTILES, static_cast<int>(visibleIds.size()), static_cast<int>(projectiles.size()));
+
+    snapshot.lives = player.lives;
+    snapshot.bonusLives = player.bonusLives;
+    snapshot.keys = player.keys;
+    snapshot.valid = true;
+}
+
+// Рисует снимок: статический слой, один пакет сущностей, HUD и оверлей.
+// Состояние отрисовки (вид, пакет, HUD) принадлежит тому потоку, что рисует.
+class SnapshotRenderer {
+public:
+    SnapshotRenderer(const sf::RenderWindow& window, const SpriteAtlas& atlas)
+        : atlas(atlas), view(sf::Vector2f(400.f, 300.f), sf::Vector2f(800.f, 600.f)), uiView(window.getDefaultView()),
+        entityBatch(atlas), hud(atlas), debugOverlay(atlas) {}
+
+    void draw(sf::RenderWindow& window, const RenderSnapshot& snapshot, float alpha, float renderFrameMs) {
+        view.setCenter(lerpPosition(snapshot.cameraPrevious, snapshot.cameraCurrent, alpha));
+
+        window.clear();
+        window.setView(view);
+        tileRenderer.draw(window, view, atlas);
+        stats = snapshot.stats;
+        stats.set(RenderStats::TILE_CHUNKS, tileRenderer.getDrawCallCount(), tileRenderer.getChunkCount());
+        stats.renderFrameMs = renderFrameMs;
+
+        entityBatch.begin();
+        for (const RenderSnapshot::Item& item : snapshot.items) {
+            entityBatch.addSprite(item.sprite, lerpPosition(item.previous, item.current, alpha), item.rotation,
+                item.color, item.scale);
+        }
+        entityBatch.draw(window);
+
+        window.setView(uiView);
+        hud.update(snapshot.lives, snapshot.bonusLives, snapshot.keys, snapshot.windowSize);
+        hud.draw(window);
+        debugOverlay.setVisible(snapshot.showOverlay);
+        debugOverlay.draw(window, stats);
+
+        window.display();
+    }
+
+private:
+    const SpriteAtlas& atlas;
+    sf::View view;
+    sf::View uiView;
+    EntityBatch entityBatch;
+    Hud hud;
+    DebugOverlay debugOverlay;
+    RenderStats stats;
+};
+
+// Время кадра одного потока: последнее, среднее и максимум
+struct FrameTimeStats {
+    uint64_t count = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+    float lastMs = 0.0f;
+
+    void record(double ms) {
+        count++;
+        totalMs += ms;
+        maxMs = std::max(maxMs, ms);
+        lastMs = static_cast<float>(ms);
+    }
+
+    void print(const std::string& label) const {
+        if (count == 0) return;
+        std::cout << label << ": " << count << " frames, avg " << totalMs / count
+            << " ms, max " << maxMs << " ms" << std::endl;
+    }
+};
+
+// Поток отрисовки: владеет контекстом окна и рисует последний опубликованный
+// снимок, интерполируя по времени, прошедшему с его публикации. События окна
+// по требованию ОС остаются в главном потоке, который его создал.
+class RenderThread {
+public:
+    RenderThread(sf::RenderWindow& window, SnapshotTripleBuffer& snapshots, const SpriteAtlas& atlas)
+        : window(window), snapshots(snapshots), renderer(window, atlas) {}
+
+    ~RenderThread() {
+        stop();
+    }
+
+    void start() {
+        if (thread.joinable()) return;
+        if (!window.setActive(false)) {
+            std::cerr << "Failed to release the window context for the render thread" << std::endl;
+        }
+        running = true;
+        thread = std::thread([this]() { run(); });
+    }
+
+    void stop() {
+        if (!thread.joinable()) return;
+        running = false;
+        thread.join();
+        if (!window.setActive(true)) {
+            std::cerr << "Failed to reacquire the window context" << std::endl;
+        }
+    }
+
+    const FrameTimeStats& getFrameStats() const { return frameStats; }
+
+private:
+    sf::RenderWindow& window;
+    SnapshotTripleBuffer& snapshots;
+    SnapshotRenderer renderer;
+    FrameTimeStats frameStats;
+    std::thread thread;
+    std::atomic<bool> running{ false };
+
+    void run() {
+        if (!window.setActive(true)) {
+            std::cerr << "Render thread failed to activate the window context" << std::endl;
+            return;
+        }
+        while (running) {
+            auto frameStart = std::chrono::steady_clock::now();
+            snapshots.acquire();
+            const RenderSnapshot& snapshot = snapshots.readBuffer();
+            if (!snapshot.valid) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            float sincePublish = std::chrono::duration<float>(frameStart - snapshot.publishedAt).count();
+            float alpha = std::clamp(sincePublish / snapshot.tickDuration, 0.0f, 1.0f);
+            renderer.draw(window, snapshot, alpha, frameStats.lastMs);
+            frameStats.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count());
+        }
+        if (!window.setActive(false)) {
+            std::cerr << "Render thread failed to release the window context" << std::endl;
+        }
+    }
+};
+
+// Время смены уровня: от обнаружения levelCompleted до готовой новой карты
+struct LevelTransitionStats {
+    int count = 0;
+    double totalMs = 0.0;
+    double maxMs = 0.0;
+
+    void record(std::chrono::steady_clock::time_point start) {
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        count++;
+        totalMs += ms;
+        maxMs = std::max(maxMs, ms);
+        std::cout << "Level transition: " << ms << " ms (avg " << totalMs / count
+            << " ms, max " << maxMs << " ms over " << count << ")" << std::endl;
+    }
+};
+
+// Микробенчмарк поиска пути на сгенерированных картах 34x34 (лабиринты конструктора
+// LevelGenerator) и на комнатах generateNewLevel: запуск с ключом --bench-path
+void runPathfindingBenchmark() {
+    const int mapCount = 5;
+    std::mt19937 rng(12345);
+    PathBenchmarkStats mazeStats;
+    PathBenchmarkStats roomStats;
+
+    for (int m = 0; m < mapCount; ++m) {
+        LevelGenerator generator;
+        benchmarkPathfindingMap(generator.getLevel(5), rng, mazeStats);
+        generator.generateNewLevel(6);
+        benchmarkPathfindingMap(generator.getLevel(6), rng, roomStats);
+    }
+
+    printPathBenchmarkStats("Pathfinding benchmark, maze levels", mazeStats);
+    printPathBenchmarkStats("Pathfinding benchmark, room levels", roomStats);
+}
+
+// Стоимость тика с 500 одновременными снарядами в обоих режимах на лабиринте
+// LevelGenerator: запуск с ключом --bench-projectiles
+double benchmarkProjectileMode(ProjectileMode mode, const std::vector<std::vector<int>>& map,
+    const std::vector<sf::Vector2f>& spawnPoints, int projectileCount, int ticks) {
+    const float tickDuration = 1.0f / 60.0f;
+    const WeaponType& weapon = WEAPONS[mode == ProjectileMode::Body ? 0 : 1];
+    b2World world(b2Vec2(0, 0));
+    StaticGeometry geometry;
+    geometry.build(map, cellSize, world);
+    BulletPool bullets(world, projectileCount);
+    ProjectileSystem projectiles(projectileCount);
+    std::vector<EnemyHandle> hits;
+    std::mt19937 rng(777);
+    std::uniform_int_distribution<size_t> spawnDist(0, spawnPoints.size() - 1);
+    std::uniform_real_distribution<float> angleDist(0.0f, 2.0f * b2_pi);
+
+    double totalMs = 0.0;
+    for (int tick = 0; tick < ticks; ++tick) {
+        size_t alive = mode == ProjectileMode::Body ? bullets.size() : projectiles.size();
+        for (size_t i = alive; i < static_cast<size_t>(projectileCount); ++i) {
+            float angle = angleDist(rng);
+            b2Vec2 direction(std::cos(angle), std::sin(angle));
+            if (mode == ProjectileMode::Body) {
+                bullets.acquire(spawnPoints[spawnDist(rng)], direction, weapon.speed);
+            }
+            else {
+                projectiles.spawn(spawnPoints[spawnDist(rng)], direction, weapon.speed, weapon.maxDistance);
+            }
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        world.Step(tickDuration, 8, 3);
+        if (mode == ProjectileMode::Body) {
+            updateBullets(bullets, tickDuration);
+        }
+        else {
+            hits.clear();
+            projectiles.update(world, tickDuration, hits);
+        }
+        totalMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+    return totalMs / ticks;
+}
+
+void runProjectileBenchmark() {
+    const int projectileCount = 500;
+    const int ticks = 600;
+    LevelGenerator generator;
+    const auto& map = generator.getLevel(5);
+    std::vector<sf::Vector2f> spawnPoints;
+    for (size_t y = 0; y < map.size(); ++y) {
+        for (size_t x = 0; x < map[y].size(); ++x) {
+            if (map[y][x] != WALL) {
+                spawnPoints.push_back(sf::Vector2f(x * cellSize + cellSize / 2, y * cellSize + cellSize / 2));
+            }
+        }
+    }
+    if (spawnPoints.empty()) return;
+
+    double bodyMs = benchmarkProjectileMode(ProjectileMode::Body, map, spawnPoints, projectileCount, ticks);
+    double raycastMs = benchmarkProjectileMode(ProjectileMode::Raycast, map, spawnPoints, projectileCount, ticks);
+    std::cout << "Projectile benchmark, " << projectileCount << " projectiles, " << ticks << " ticks" << std::endl;
+    std::cout << "  CCD bodies:      " << bodyMs << " ms/tick" << std::endl;
+    std::cout << "  swept raycasts:  " << raycastMs << " ms/tick" << std::endl;
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    float tickRate = 60.0f;
+    int maxCatchUpSteps = 5;
+    bool singleThreadedRender = false;
+    for (int i = 1; i < argc; ++i) {
+        if (std::string(argv[i]) == "--bench-path") {
+            runPathfindingBenchmark();
+            return 0;
+        }
+        if (std::string(argv[i]) == "--bench-projectiles") {
+            runProjectileBenchmark();
+            return 0;
+        }
+        if (std::string(argv[i]) == "--tick-rate" && i + 1 < argc) {
+            tickRate = std::max(10.0f, static_cast<float>(std::atof(argv[++i])));
+        }
+        else if (std::string(argv[i]) == "--max-catch-up" && i + 1 < argc) {
+            maxCatchUpSteps = std::max(1, std::atoi(argv[++i]));
+        }
+        else if (std::string(argv[i]) == "--single-thread-render") {
+            singleThreadedRender = true;
+        }
+    }
+
     sf::RenderWindow window(sf::VideoMode({ 800, 600 }), "Roguelike");
     window.setFramerateLimit(60);
+    SpriteAtlas spriteAtlas;
+    if (!spriteAtlas.load()) {
+        return -1;
+    }
     LevelGenerator levelGenerator;
     levelGenerator.loadState();
+    GameEventSink gameEvents;
+    LevelTransitionStats transitionStats;
     b2World world(b2Vec2(0, 0));
     auto levelStartTime = std::chrono::steady_clock::now();
     int playerDeaths = 0;
@@ -2070,11 +5467,11 @@ int main() {
     player.body->CreateFixture(&playerFixture);
 
     std::vector<Trap> traps;
-    std::vector<Wall> walls;
-    std::vector<Pit> pits;
-    std::vector<Enemy*> enemies;
-    std::vector<Bullet*> bullets;
-    std::vector<Heart> hearts;
+    EnemyStore enemies;
+    BulletPool bullets(world);
+    ProjectileSystem projectiles;
+    std::vector<EnemyHandle> projectileHits;
+    std::vector<uint32_t> visibleIds;
     std::vector<Key> keys;
     std::vector<Door> doors;
     const float cellSize = 32.0f;
@@ -2082,79 +5479,148 @@ int main() {
     std::vector<HealthPickup> healthPickups;
     bool levelCompleted = false;
     int currentLevel = 0;
-    parseMap(levelGenerator.getLevel(currentLevel), cellSize, world, player, walls, pits, enemies,
+    parseMap(levelGenerator.getLevel(currentLevel), cellSize, world, player, enemies,
         exit, healthPickups, traps, keys, doors);
-    for (int i = 0; i < player.lives; ++i) {
-        Heart heart;
-        heart.shape = sf::CircleShape(8.0f, 30);
-        heart.shape.setFillColor(sf::Color::Red);
-        heart.shape.setOrigin(sf::Vector2f(8.0f, 8.0f));
-        heart.shape.setPosition(sf::Vector2f(20.0f + i * 21.0f, 20.0f));
-        hearts.push_back(heart);
-    }
     ContactListener* contactListener = new ContactListener(
         bullets, enemies, player, exit, healthPickups,
         levelCompleted, world, traps, keys, doors,
-        playerDeaths, enemiesKilled, trapsTriggered, healthPicked
+        playerDeaths, enemiesKilled, trapsTriggered, healthPicked, gameEvents
     );
     world.SetContactListener(contactListener);
 
     auto lastShotTime = std::chrono::steady_clock::now();
+    PathRequestService pathRequests(2, 1.5f);
+    AIScheduler aiScheduler;
+    JobSystem jobSystem(std::min(7, std::max(1, static_cast<int>(std::thread::hardware_concurrency())) - 1));
+    // Вид камеры в симуляции нужен планировщику ИИ; поток отрисовки держит свой
     sf::View view(sf::Vector2f(400.f, 300.f), sf::Vector2f(800.f, 600.f));
-    sf::View uiView = window.getDefaultView();
+    FixedTimestep fixedStep(tickRate, maxCatchUpSteps);
+    SnapshotTripleBuffer snapshots;
+    SnapshotRenderer inlineRenderer(window, spriteAtlas);
+    RenderThread renderThread(window, snapshots, spriteAtlas);
+    FrameTimeStats simFrameStats;
+    FrameTimeStats inlineRenderStats;
+    bool showOverlay = false;
+    bool running = true;
+    sf::Vector2u windowSize = window.getSize();
+    if (!singleThreadedRender) {
+        renderThread.start();
+    }
     sf::Clock clock;
-    while (window.isOpen()) {
-        float deltaTime = clock.restart().asSeconds();
-        if (player.enemyStartDelayTimer > 0) {
-            player.enemyStartDelayTimer -= deltaTime;
-            if (player.enemyStartDelayTimer <= 0) {
-                player.enemiesCanMove = true;
-                std::cout << "Enemies can now move!" << std::endl;
-            }
-        }
+    while (running) {
+        float frameTime = clock.restart().asSeconds();
+        auto simFrameStart = std::chrono::steady_clock::now();
         while (auto event = window.pollEvent()) {
             if (event->is<sf::Event::Closed>()) {
-                window.close();
+                running = false;
             }
             if (event->is<sf::Event::KeyPressed>() &&
                 event->getIf<sf::Event::KeyPressed>()->code == sf::Keyboard::Key::Escape) {
-                window.close();
+                running = false;
+            }
+            if (event->is<sf::Event::KeyPressed>() &&
+                event->getIf<sf::Event::KeyPressed>()->code == sf::Keyboard::Key::F3) {
+                showOverlay = !showOverlay;
+            }
+            if (const auto* resized = event->getIf<sf::Event::Resized>()) {
+                windowSize = resized->size;
             }
         }
-        updatePlayer(player, deltaTime);
-        view.setCenter(player.shape.getPosition());
 
-        // Стрельба
-        auto currentTime = std::chrono::steady_clock::now();
-        if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Space) &&
-            player.lastShotTime >= 0.5f) {
-            createBullet(bullets, player, world);
-            player.lastShotTime = 0.0f;
-        }
-        world.Step(1.0f / 60.0f, 8, 3);
-        if (player.enemiesCanMove) {
-            updateEnemies(enemies, player.shape.getPosition(), world, deltaTime, doors);
-        }
-        else {
-            for (auto* enemy : enemies) {
-                if (enemy->body) {
-                    enemy->shape.setPosition(sf::Vector2f(enemy->body->GetPosition().x, enemy->body->GetPosition().y));
+        const float deltaTime = fixedStep.getTickDuration();
+        int steps = fixedStep.beginFrame(frameTime);
+        for (int step = 0; step < steps && !levelCompleted; ++step) {
+            player.previousPosition = sf::Vector2f(player.body->GetPosition().x, player.body->GetPosition().y);
+            for (size_t i = 0; i < enemies.size(); ++i) {
+                enemies.previousPosition[i] = enemies.position[i];
+            }
+            for (size_t i = 0; i < bullets.size(); ++i) {
+                bullets[i].previousPosition = sf::Vector2f(bullets[i].body->GetPosition().x, bullets[i].body->GetPosition().y);
+            }
+
+            if (player.enemyStartDelayTimer > 0) {
+                player.enemyStartDelayTimer -= deltaTime;
+                if (player.enemyStartDelayTimer <= 0) {
+                    player.enemiesCanMove = true;
+                    std::cout << "Enemies can now move!" << std::endl;
                 }
             }
-        }
-        updateBullets(bullets, world);
+            updatePlayer(player, deltaTime);
+            view.setCenter(player.shape.getPosition());
 
-        updateHealthPickups(healthPickups, world);
+            // Стрельба
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Num1)) {
+                player.weapon = 0;
+            }
+            else if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Num2) && WEAPON_COUNT > 1) {
+                player.weapon = 1;
+            }
+            const WeaponType& weapon = WEAPONS[player.weapon];
+            if (sf::Keyboard::isKeyPressed(sf::Keyboard::Key::Space) &&
+                player.lastShotTime >= weapon.fireInterval) {
+                createBullet(bullets, projectiles, player, weapon);
+                player.lastShotTime = 0.0f;
+            }
+            sf::FloatRect cameraRect(view.getCenter() - view.getSize() / 2.0f, view.getSize());
+            physicsActivation.update(cameraRect, enemies, traps, healthPickups, keys, doors);
+            world.Step(deltaTime, 8, 3);
+            contactListener->resolvePendingContacts();
+            projectileHits.clear();
+            projectiles.update(world, deltaTime, projectileHits);
+            for (EnemyHandle enemy : projectileHits) {
+                contactListener->resolveProjectileHit(enemy);
+            }
+            levelGenerator.consumeEvents(gameEvents);
+            pathRequests.beginFrame(navGrid);
+            if (player.enemiesCanMove) {
+                aiScheduler.beginFrame(enemies, player.shape.getPosition(), cameraRect, deltaTime);
+                updateEnemies(enemies, player.shape.getPosition(), world, pathRequests, aiScheduler, jobSystem);
+            }
+            else {
+                for (size_t i = 0; i < enemies.size(); ++i) {
+                    syncEnemyPosition(enemies, i);
+                }
+            }
+            updateBullets(bullets, deltaTime);
 
-        updateTraps(traps, world, deltaTime);
+            updateHealthPickups(healthPickups, world);
 
-        updateDoors(doors, world);
+            updateTraps(traps, world, deltaTime);
 
-        updateHealthPickupsAnimation(healthPickups, deltaTime);
+            updateDoors(doors, world);
 
-        updateHearts(hearts, player, player.bonusLives);
+            updateHealthPickupsAnimation(healthPickups, deltaTime);
+        }
+        // Снимок публикуется раз за кадр после последнего тика; при смене уровня
+        // ниже карта перестраивается, и снимок будет собран уже с новым уровнем
+        if (steps > 0 && !levelCompleted) {
+            RenderSnapshot& snapshot = snapshots.writeBuffer();
+            buildRenderSnapshot(snapshot, player, enemies, bullets, projectiles, healthPickups, traps, view, visibleIds);
+            snapshot.showOverlay = showOverlay;
+            snapshot.windowSize = windowSize;
+            snapshot.stats.simFrameMs = simFrameStats.lastMs;
+            snapshot.tickDuration = deltaTime;
+            snapshot.publishedAt = std::chrono::steady_clock::now();
+            snapshots.publish();
+        }
         if (levelCompleted) {
+            auto transitionStartTime = std::chrono::steady_clock::now();
             std::cout << "Level " << currentLevel + 1 << " passed! Good job!" << std::endl;
+            aiScheduler.printStats();
+            aiScheduler.resetStats();
+            std::cout << "Path requests solved: " << pathRequests.getSolvedCount()
+                << ", coalesced: " << pathRequests.getCoalescedCount() << std::endl;
+            std::cout << "Player flow field rebuilds (total): " << playerFlowField.getRebuildCount() << std::endl;
+            if (navGrid.getWidth() * navGrid.getHeight() >= HIERARCHICAL_PATH_MIN_CELLS) {
+                std::cout << "HPA abstract graph nodes: " << hierarchicalPathfinder.getNodeCount() << std::endl;
+            }
+            std::cout << "Field of view recomputes (total): " << playerFieldOfView.getRecomputeCount() << std::endl;
+            std::cout << "Physics regions active: " << physicsActivation.getActiveRegionCount()
+                << " of " << physicsActivation.getRegionCount() << std::endl;
+            std::cout << "Static walls: " << staticGeometry.getWallCellCount()
+                << " cells in " << staticGeometry.getFixtureCount() << " fixtures" << std::endl;
+            std::cout << "Simulation ticks dropped (total): " << fixedStep.getDroppedTicks() << std::endl;
+            std::cout << "Bullet pool exhausted (total): " << bullets.getExhaustedCount() << std::endl;
             currentLevel++;
             auto levelEndTime = std::chrono::steady_clock::now();
             float levelTime = std::chrono::duration<float>(levelEndTime - levelStartTime).count();
@@ -2175,7 +5641,7 @@ int main() {
             if (player.lives <= 0) {
                 std::cout << "Game Over! Restarting..." << std::endl;
 
-                clearGameObjects(world, walls, pits, enemies, bullets,
+                clearGameObjects(world, enemies, bullets, projectiles,
                     healthPickups, traps, keys, doors);
 
                 player = Player();
@@ -2213,18 +5679,20 @@ int main() {
 
                 resetContactListener(world, contactListener, bullets, enemies, player, exit,
                     healthPickups, levelCompleted, traps, keys, doors,
-                    playerDeaths, enemiesKilled, trapsTriggered, healthPicked);
+                    playerDeaths, enemiesKilled, trapsTriggered, healthPicked, gameEvents);
 
                 currentLevel = 0;
-                parseMap(levelGenerator.getLevel(currentLevel), cellSize, world, player, walls, pits,
+                parseMap(levelGenerator.getLevel(currentLevel), cellSize, world, player,
                     enemies, exit, healthPickups, traps, keys, doors);
 
                 levelCompleted = false;
-                updateHearts(hearts, player, player.bonusLives);
+                transitionStats.record(transitionStartTime);
+                fixedStep.reset();
+                clock.restart();
                 continue;
             }
             else if (currentLevel < levelGenerator.getLevelCount()) {
-                clearGameObjects(world, walls, pits, enemies, bullets,
+                clearGameObjects(world, enemies, bullets, projectiles,
                     healthPickups, traps, keys, doors);
 
                 int savedLives = player.lives;
@@ -2266,21 +5734,23 @@ int main() {
 
                 resetContactListener(world, contactListener, bullets, enemies, player, exit,
                     healthPickups, levelCompleted, traps, keys, doors,
-                    playerDeaths, enemiesKilled, trapsTriggered, healthPicked);
+                    playerDeaths, enemiesKilled, trapsTriggered, healthPicked, gameEvents);
 
-                parseMap(levelGenerator.getLevel(currentLevel), cellSize, world, player, walls, pits,
+                parseMap(levelGenerator.getLevel(currentLevel), cellSize, world, player,
                     enemies, exit, healthPickups, traps, keys, doors);
 
                 levelCompleted = false;
 
-                updateHearts(hearts, player, player.bonusLives);
+                transitionStats.record(transitionStartTime);
+                fixedStep.reset();
+                clock.restart();
 
                 continue;
             }
             else {
                 std::cout << "You passed all levels, congratulations! Restarting..." << std::endl;
 
-                clearGameObjects(world, walls, pits, enemies, bullets,
+                clearGameObjects(world, enemies, bullets, projectiles,
                     healthPickups, traps, keys, doors);
                 player = Player();
                 player.shape = sf::CircleShape(12.0f, 30);
@@ -2316,81 +5786,52 @@ int main() {
 
                 resetContactListener(world, contactListener, bullets, enemies, player, exit,
                     healthPickups, levelCompleted, traps, keys, doors,
-                    playerDeaths, enemiesKilled, trapsTriggered, healthPicked);
+                    playerDeaths, enemiesKilled, trapsTriggered, healthPicked, gameEvents);
                 currentLevel = 0;
-                parseMap(levelGenerator.getLevel(currentLevel), cellSize, world, player, walls, pits,
+                parseMap(levelGenerator.getLevel(currentLevel), cellSize, world, player,
                     enemies, exit, healthPickups, traps, keys, doors);
 
                 levelCompleted = false;
-                updateHearts(hearts, player, player.bonusLives);
+                transitionStats.record(transitionStartTime);
+                fixedStep.reset();
+                clock.restart();
                 continue;
             }
         }
 
-        window.clear();
-        window.setView(view);
-        window.draw(exit.shape);
-        for (const auto& health : healthPickups) {
-            if (health.active) {
-                window.draw(health.shape);
-            }
-        }
-
-        for (const auto& wall : walls) {
-            window.draw(wall.shape);
-        }
-
-        for (const auto& trap : traps) {
-            if (trap.active) {
-                window.draw(trap.shape);
-            }
-        }
-
-
-        for (const auto& pit : pits) {
-            window.draw(pit.shape);
-        }
-
-        for (const auto& key : keys) {
-            if (!key.collected) {
-                window.draw(key.shape);
-            }
-        }
-
-        for (const auto& door : doors) {
-            if (!door.opened) {
-                window.draw(door.shape);
-            }
-        }
-        window.draw(player.shape);
-        window.draw(player.directionArc);
+        simFrameStats.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - simFrameStart).count());
 
-        for (const auto* enemy : enemies) {
-            if (enemy->health > 0) {
-                window.draw(enemy->shape);
+        if (singleThreadedRender) {
+            auto renderStart = std::chrono::steady_clock::now();
+            snapshots.acquire();
+            if (snapshots.readBuffer().valid) {
+                inlineRenderer.draw(window, snapshots.readBuffer(), fixedStep.getAlpha(), inlineRenderStats.lastMs);
             }
+            inlineRenderStats.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - renderStart).count());
         }
-        for (const auto& bullet : bullets) {
-            window.draw(bullet->shape);
-        }
-
-        window.setView(uiView);
-        for (const auto& heart : hearts) {
-            window.draw(heart.shape);
+        else {
+            // Отрисовка идёт в своём потоке; симуляция ждёт до следующего тика сама
+            float untilNextTick = fixedStep.getTickDuration() * (1.0f - fixedStep.getAlpha());
+            std::this_thread::sleep_for(std::chrono::duration<float>(untilNextTick));
         }
-        drawKeys(window, player); 
+    }
 
-        window.display();
+    renderThread.stop();
+    window.close();
+    simFrameStats.print("Simulation thread");
+    if (singleThreadedRender) {
+        inlineRenderStats.print("Render (inline)");
     }
-   
-    for (auto* bullet : bullets) {
-        world.DestroyBody(bullet->body);
-        delete bullet;
+    else {
+        renderThread.getFrameStats().print("Render thread");
     }
-    for (auto* enemy : enemies) {
-        world.DestroyBody(enemy->body);
-        delete enemy;
+
+    for (b2Body* enemyBody : enemies.body) {
+        if (enemyBody) {
+            world.DestroyBody(enemyBody);
+        }
     }
+    enemies.clear();
 
     delete contactListener;
     levelGenerator.saveState();